@@ -0,0 +1,335 @@
+/*
+ * @copyright (c) 2008, Hedspi, Hanoi University of Technology
+ * @author Huu-Duc Nguyen
+ * @version 1.0
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "batch.h"
+
+#ifndef _WIN32
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "vm.h"
+
+#define IMAGE_HASH_SIZE 1024
+
+struct Image_ {
+  char* fileName;
+  CodeBlock* codeBlock;    // NULL when the file can't be loaded
+  Program* program;        // NULL when the code was rejected
+  VMStatus status;         // why it was rejected
+  CodeAddress pc;
+  struct Image_* next;     // in the same hash bucket
+};
+
+typedef struct Image_ Image;
+
+struct Job_ {
+  Image* image;
+  char* input;
+  char* output;
+  int line;                // in the manifest
+  char* badFile;           // the file that could not be opened, if any
+  VMStatus status;
+  CodeAddress pc;
+};
+
+typedef struct Job_ Job;
+
+/*
+ * Every worker owns a deque of job indexes. The owner takes jobs from
+ * the tail, thieves take them from the head, both under the lock. All
+ * jobs are dealt before the workers start, so a worker that finds every
+ * deque empty is done.
+ */
+
+struct Worker_ {
+  pthread_t thread;
+  pthread_mutex_t lock;
+  int* queue;
+  int head;
+  int tail;
+  VM* vm;
+};
+
+typedef struct Worker_ Worker;
+
+static Image* images[IMAGE_HASH_SIZE];
+static Job* jobs;
+static int jobCount;
+static Worker* workers;
+static int workerCount;
+
+static char* copyString(char* s) {
+  char* t = (char*) malloc(strlen(s) + 1);
+
+  strcpy(t, s);
+  return t;
+}
+
+static unsigned hashString(char* s) {
+  unsigned h = 0;
+
+  while (*s != '\0')
+    h = h * 31 + (unsigned char) *s++;
+  return h % IMAGE_HASH_SIZE;
+}
+
+static Image* findImage(char* fileName, int registerCode, int jit) {
+  unsigned h = hashString(fileName);
+  Image* image;
+
+  for (image = images[h]; image != NULL; image = image->next)
+    if (strcmp(image->fileName, fileName) == 0) return image;
+
+  image = (Image*) malloc(sizeof(Image));
+  image->fileName = copyString(fileName);
+  image->program = NULL;
+  image->codeBlock = mapCode(fileName);
+  if (image->codeBlock != NULL)
+    image->status = loadProgram(image->codeBlock, registerCode, jit, &image->program, &image->pc);
+  image->next = images[h];
+  images[h] = image;
+  return image;
+}
+
+static void freeImages(void) {
+  Image* image;
+  int i;
+
+  for (i = 0; i < IMAGE_HASH_SIZE; i ++)
+    while (images[i] != NULL) {
+      image = images[i];
+      images[i] = image->next;
+      if (image->program != NULL) freeProgram(image->program);
+      if (image->codeBlock != NULL) freeCodeBlock(image->codeBlock);
+      free(image->fileName);
+      free(image);
+    }
+}
+
+/******************* Reading the manifest ******************************/
+
+static int addJob(char* manifest, int line, char* text, int* capacity, int registerCode, int jit) {
+  char* field[3];
+  Job* job;
+  int k;
+
+  for (k = 0; k < 3; k ++)
+    if ((field[k] = strtok(k == 0 ? text : NULL, " \t\r\n")) == NULL) break;
+  if ((k == 0) || (field[0][0] == '#')) return 1;
+  if ((k < 3) || (strtok(NULL, " \t\r\n") != NULL)) {
+    fprintf(stderr, "%s:%d: expected image, input and output files\n", manifest, line);
+    return 0;
+  }
+
+  if (jobCount == *capacity) {
+    *capacity *= 2;
+    jobs = (Job*) realloc(jobs, *capacity * sizeof(Job));
+  }
+  job = jobs + jobCount ++;
+  job->image = findImage(field[0], registerCode, jit);
+  job->input = copyString(field[1]);
+  job->output = copyString(field[2]);
+  job->line = line;
+  job->badFile = NULL;
+  job->status = VM_HALT;
+  job->pc = 0;
+  return 1;
+}
+
+static int readManifest(char* manifest, int registerCode, int jit) {
+  char text[MAX_MANIFEST_LINE];
+  FILE* f;
+  int capacity = 64;
+  int line = 0;
+  int ok = 1;
+
+  f = fopen(manifest, "r");
+  if (f == NULL) {
+    fprintf(stderr, "Can\'t read %s!\n", manifest);
+    return 0;
+  }
+
+  jobs = (Job*) malloc(capacity * sizeof(Job));
+  jobCount = 0;
+  while (ok && (fgets(text, MAX_MANIFEST_LINE, f) != NULL)) {
+    line ++;
+    if ((strchr(text, '\n') == NULL) && !feof(f)) {
+      fprintf(stderr, "%s:%d: line too long\n", manifest, line);
+      ok = 0;
+    } else ok = addJob(manifest, line, text, &capacity, registerCode, jit);
+  }
+
+  fclose(f);
+  return ok;
+}
+
+/******************* Running the jobs ******************************/
+
+static void runJob(VM* vm, Job* job) {
+  Image* image = job->image;
+  int input, output;
+
+  if ((image->codeBlock == NULL) || (image->program == NULL)) return;
+
+  input = open(job->input, O_RDONLY);
+  if (input < 0) {
+    job->badFile = job->input;
+    return;
+  }
+  output = open(job->output, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+  if (output < 0) {
+    close(input);
+    job->badFile = job->output;
+    return;
+  }
+
+  resetVM(vm, input, output);
+  job->status = runProgram(vm, image->program);
+  job->pc = vm->pc;
+
+  close(input);
+  if (close(output) != 0) job->badFile = job->output;
+}
+
+// The next job for worker w: its own newest, or the oldest of another; -1 when none is left
+static int takeJob(int w) {
+  Worker* worker;
+  int job = -1;
+  int k;
+
+  worker = workers + w;
+  pthread_mutex_lock(&worker->lock);
+  if (worker->head < worker->tail) job = worker->queue[-- worker->tail];
+  pthread_mutex_unlock(&worker->lock);
+
+  for (k = 1; (k < workerCount) && (job < 0); k ++) {
+    worker = workers + (w + k) % workerCount;
+    pthread_mutex_lock(&worker->lock);
+    if (worker->head < worker->tail) job = worker->queue[worker->head ++];
+    pthread_mutex_unlock(&worker->lock);
+  }
+  return job;
+}
+
+static void* work(void* arg) {
+  int w = (int) (long) arg;
+  int job;
+
+  while ((job = takeJob(w)) >= 0)
+    runJob(workers[w].vm, jobs + job);
+  return NULL;
+}
+
+static int countWorkers(void) {
+  long n = sysconf(_SC_NPROCESSORS_ONLN);
+
+  if (n > MAX_BATCH_WORKERS) n = MAX_BATCH_WORKERS;
+  if (n > jobCount) n = jobCount;
+  return (n < 1) ? 1 : (int) n;
+}
+
+/******************* Reporting ******************************/
+
+static void writeFailure(char* manifest, Job* job, VMStatus status, CodeAddress pc) {
+  CodeBlock* codeBlock = job->image->codeBlock;
+  int line, column;
+
+  fprintf(stderr, "%s:%d: %d: %s", manifest, job->line, pc, vmStatusToString(status));
+  if (findLine(codeBlock, pc, &line, &column))
+    fprintf(stderr, " (line %d, column %d)", line, column);
+  fprintf(stderr, "\n");
+}
+
+static int reportJobs(char* manifest) {
+  Job* job;
+  int failures = 0;
+  int i;
+
+  for (i = 0; i < jobCount; i ++) {
+    job = jobs + i;
+    if (job->image->codeBlock == NULL)
+      fprintf(stderr, "%s:%d: Can\'t load %s!\n", manifest, job->line, job->image->fileName);
+    else if (job->image->program == NULL)
+      writeFailure(manifest, job, job->image->status, job->image->pc);
+    else if (job->badFile != NULL)
+      fprintf(stderr, "%s:%d: Can\'t open %s!\n", manifest, job->line, job->badFile);
+    else if (job->status != VM_HALT)
+      writeFailure(manifest, job, job->status, job->pc);
+    else continue;
+    failures ++;
+  }
+
+  fprintf(stderr, "%d jobs, %d failed\n", jobCount, failures);
+  return failures;
+}
+
+/******************************************************************/
+
+int runBatch(char* manifest, int registerCode, int jit) {
+  Worker* worker;
+  int failures;
+  int i, w;
+
+  if (!readManifest(manifest, registerCode, jit)) failures = -1;
+  else {
+    workerCount = countWorkers();
+    workers = (Worker*) malloc(workerCount * sizeof(Worker));
+    for (w = 0; w < workerCount; w ++) {
+      worker = workers + w;
+      pthread_mutex_init(&worker->lock, NULL);
+      worker->queue = (int*) malloc((jobCount / workerCount + 1) * sizeof(int));
+      worker->head = 0;
+      worker->tail = 0;
+      worker->vm = createVM(DEFAULT_STACK_SIZE);
+      worker->vm->registerCode = registerCode;
+      worker->vm->jit = jit;
+    }
+
+    // Dealt in reverse, so that each owner starts with its earliest job
+    for (i = jobCount - 1; i >= 0; i --) {
+      worker = workers + i % workerCount;
+      worker->queue[worker->tail ++] = i;
+    }
+
+    for (w = 1; w < workerCount; w ++)
+      if (pthread_create(&workers[w].thread, NULL, work, (void*) (long) w) != 0)
+	workers[w].thread = pthread_self();
+    work((void*) 0);
+    for (w = 1; w < workerCount; w ++)
+      if (!pthread_equal(workers[w].thread, pthread_self()))
+	pthread_join(workers[w].thread, NULL);
+
+    failures = reportJobs(manifest);
+
+    for (w = 0; w < workerCount; w ++) {
+      pthread_mutex_destroy(&workers[w].lock);
+      free(workers[w].queue);
+      freeVM(workers[w].vm);
+    }
+    free(workers);
+  }
+
+  for (i = 0; i < jobCount; i ++) {
+    free(jobs[i].input);
+    free(jobs[i].output);
+  }
+  free(jobs);
+  freeImages();
+  return failures;
+}
+
+#else
+
+int runBatch(char* manifest, int registerCode, int jit) {
+  fprintf(stderr, "Batch mode is not available on this platform.\n");
+  return -1;
+}
+
+#endif
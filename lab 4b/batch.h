@@ -0,0 +1,28 @@
+/*
+ * @copyright (c) 2008, Hedspi, Hanoi University of Technology
+ * @author Huu-Duc Nguyen
+ * @version 1.0
+ */
+
+#ifndef __BATCH_H__
+#define __BATCH_H__
+
+#define MAX_MANIFEST_LINE 4096
+#define MAX_BATCH_WORKERS 256
+
+/*
+ * Runs every job of a manifest, one per line:
+ *
+ *   image input output
+ *
+ * Blank lines and lines starting with '#' are skipped. Each distinct
+ * image is loaded and verified once, then shared by all of its jobs.
+ * Jobs run on a pool of worker threads, one per processor, each with a
+ * VM of its own; a worker that runs out of jobs steals from the others.
+ * Failures are reported on stderr in manifest order.
+ */
+
+// The number of failed jobs, or -1 when the manifest can't be run at all
+int runBatch(char* manifest, int registerCode, int jit);
+
+#endif
@@ -7,9 +7,15 @@
 #include <stdio.h>
 #include "reader.h"
 #include "codegen.h"  
+#include "kplb.h"
+#include "emitc.h"
+#include "peephole.h"
+#include "verify.h"
+#include "error.h"
 
-#define CODE_SIZE 10000
+#define INITIAL_CODE_SIZE 1024
 extern SymTab* symtab;
+extern Token* currentToken;
 
 extern Object* readiFunction;
 extern Object* readcFunction;
@@ -19,16 +25,204 @@ extern Object* writelnProcedure;
 
 CodeBlock* codeBlock;
 
+// Addresses handed out by getCurrentCodeAddress() may be jump targets,
+// so no instruction below the latest one may be fused away
+static CodeAddress fusionBarrier = 0;
+
+// emitCode only fails when the buffer can no longer grow. The new
+// instruction is credited to the token the parser has just consumed.
+static void checkEmit(int emitted) {
+  if (!emitted ||
+      !addLine(codeBlock, codeBlock->codeSize - 1, currentToken->lineNo, currentToken->colNo))
+    error(ERR_CODE_TOO_LARGE, currentToken->lineNo, currentToken->colNo);
+}
+
+// Can the last count instructions be rewritten into one?
+static int canFuse(int count) {
+  return codeBlock->codeSize - count >= fusionBarrier;
+}
+
+static Instruction* lastInstructions(int count) {
+  return codeBlock->code + codeBlock->codeSize - count;
+}
+
+static int isLocalValue(Instruction* inst, int offset) {
+  return (inst->op == OP_LV) && (inst->p == 0) && (inst->q == offset);
+}
+
+// Is the count-th instruction from the end an LC that may be folded away?
+static int isFoldableConstant(int count) {
+  return canFuse(count) && (lastInstructions(count)->op == OP_LC);
+}
+
+// Wraps around like the VM; division by 0 is never folded
+static WORD foldConstants(enum OpCode op, WORD x, WORD y) {
+  switch (op) {
+  case OP_AD: return (WORD) ((unsigned) x + (unsigned) y);
+  case OP_SB: return (WORD) ((unsigned) x - (unsigned) y);
+  case OP_ML: return (WORD) ((unsigned) x * (unsigned) y);
+  default: return (y == -1) ? (WORD) (0u - (unsigned) x) : x / y;
+  }
+}
+
+// x op value = x
+static int isIdentity(enum OpCode op, WORD value) {
+  return ((value == 0) && ((op == OP_AD) || (op == OP_SB))) ||
+    ((value == 1) && ((op == OP_ML) || (op == OP_DV)));
+}
+
+/*
+ * Arithmetic on operands that are known at compile time:
+ *   LC x; LC y; op              =>  LC x op y
+ *   LC a; AD; LC b; AD (or SB)  =>  LC a+b (or a-b); AD, likewise SB and ML
+ *   LC 0; AD (or SB)            =>  nothing
+ *   LC 1; ML (or DV)            =>  nothing
+ * Returns 1 when op is taken care of.
+ */
+static int foldArithmetic(enum OpCode op) {
+  Instruction* inst;
+
+  if (isFoldableConstant(1) && isFoldableConstant(2)) {
+    inst = lastInstructions(2);
+    if ((op != OP_DV) || (inst[1].q != 0)) {
+      inst[0].q = foldConstants(op, inst[0].q, inst[1].q);
+      codeBlock->codeSize --;
+      return 1;
+    }
+  }
+
+  if (isFoldableConstant(1) && isFoldableConstant(3)) {
+    inst = lastInstructions(3);
+    if (((op == OP_AD) || (op == OP_SB)) && ((inst[1].op == OP_AD) || (inst[1].op == OP_SB))) {
+      inst[0].q = foldConstants((inst[1].op == op) ? OP_AD : OP_SB, inst[0].q, inst[2].q);
+      codeBlock->codeSize --;
+      if (isIdentity(inst[1].op, inst[0].q)) codeBlock->codeSize -= 2;
+      return 1;
+    }
+    if ((op == OP_ML) && (inst[1].op == OP_ML)) {
+      inst[0].q = foldConstants(OP_ML, inst[0].q, inst[2].q);
+      codeBlock->codeSize --;
+      if (isIdentity(OP_ML, inst[0].q)) codeBlock->codeSize -= 2;
+      return 1;
+    }
+  }
+
+  if (isFoldableConstant(1) && isIdentity(op, lastInstructions(1)->q)) {
+    codeBlock->codeSize --;
+    return 1;
+  }
+  return 0;
+}
+
+// k when value is 2^k for a shift count k > 0, otherwise 0
+static int powerOfTwo(WORD value) {
+  int k;
+
+  for (k = 1; k <= MAX_SHIFT; k ++)
+    if (value == (1 << k)) return k;
+  return 0;
+}
+
+/*
+ * LC 2^k; ML (DV)  =>  SHL k (SHR k)
+ * A shift straight after one of the same kind adds up with it.
+ */
+static int reduceStrength(enum OpCode shift) {
+  Instruction* inst;
+  int k;
+
+  if (!isFoldableConstant(1)) return 0;
+  inst = lastInstructions(1);
+  k = powerOfTwo(inst->q);
+  if (k == 0) return 0;
+
+  if (canFuse(2) && (inst[-1].op == shift) && (inst[-1].q + k <= MAX_SHIFT)) {
+    inst[-1].q += k;
+    codeBlock->codeSize --;
+  } else {
+    inst->op = shift;
+    inst->q = k;
+  }
+  return 1;
+}
+
+// Two loads of the same variable or constant: nothing runs in between that could change it
+static int isSameLoad(Instruction* a, Instruction* b) {
+  return ((a->op == OP_LV) || (a->op == OP_LC)) && (a->op == b->op) && (a->p == b->p) && (a->q == b->q);
+}
+
+static void setInstruction(Instruction* inst, enum OpCode op, WORD q) {
+  inst->op = op;
+  inst->p = DC_VALUE;
+  inst->q = q;
+}
+
+/*
+ * x - (x / k) * k  =>  x mod k, for x a variable and k a variable or constant:
+ *   LV x; LV x; K; DV; K; ML      =>  LV x; K; MOD
+ *   LV x; LV x; SHR k; SHL k      =>  LV x; LC 2^k; MOD
+ */
+static int reduceModulo(void) {
+  Instruction* inst;
+
+  if (canFuse(4)) {
+    inst = lastInstructions(4);
+    if ((inst[0].op == OP_LV) && isSameLoad(&inst[0], &inst[1]) &&
+	(inst[2].op == OP_SHR) && (inst[3].op == OP_SHL) && (inst[2].q == inst[3].q)) {
+      setInstruction(&inst[1], OP_LC, 1 << inst[2].q);
+      setInstruction(&inst[2], OP_MOD, DC_VALUE);
+      codeBlock->codeSize --;
+      return 1;
+    }
+  }
+
+  if (canFuse(6)) {
+    inst = lastInstructions(6);
+    if ((inst[0].op == OP_LV) && isSameLoad(&inst[0], &inst[1]) && isSameLoad(&inst[2], &inst[4]) &&
+	(inst[3].op == OP_DV) && (inst[5].op == OP_ML)) {
+      inst[1] = inst[2];
+      setInstruction(&inst[2], OP_MOD, DC_VALUE);
+      codeBlock->codeSize -= 3;
+      return 1;
+    }
+  }
+  return 0;
+}
+
+// Whether x mod 2^k is 0 only depends on its low bits: LC 2^k; MOD; LC 0  =>  AND 2^k-1; LC 0
+static void reduceModuloTest(void) {
+  Instruction* inst;
+
+  if (!canFuse(3)) return;
+  inst = lastInstructions(3);
+  if ((inst[0].op == OP_LC) && (powerOfTwo(inst[0].q) > 0) && (inst[1].op == OP_MOD) &&
+      (inst[2].op == OP_LC) && (inst[2].q == 0)) {
+    setInstruction(&inst[0], OP_AND, inst[0].q - 1);
+    inst[1] = inst[2];
+    codeBlock->codeSize --;
+  }
+}
+
+// Number of static links from the current frame up to the frame of scope
+int computeNestedLevel(Scope* scope) {
+  Scope* current = symtab->currentScope;
+  int level = 0;
+
+  while ((current != NULL) && (current != scope)) {
+    current = current->outer;
+    level ++;
+  }
+  return level;
+}
+
 void genVariableAddress(Object* var) {
   // Push the address of a variable onto the stack
-  // Assuming all variables are at level 0 (current frame)
-  genLA(0, VARIABLE_OFFSET(var));
+  genLA(computeNestedLevel(VARIABLE_SCOPE(var)), VARIABLE_OFFSET(var));
 }
 
 void genVariableValue(Object* var) {
   // Push the value of a variable onto the stack
-  // Assuming all variables are at level 0 (current frame)
-  genLV(0, VARIABLE_OFFSET(var));
+  genLV(computeNestedLevel(VARIABLE_SCOPE(var)), VARIABLE_OFFSET(var));
 }
 
 int isPredefinedFunction(Object* func) {
@@ -56,144 +250,322 @@ void genPredefinedFunctionCall(Object* func) {
 }
 
 void genLA(int level, int offset) {
-  emitLA(codeBlock, level, offset);
+  checkEmit(emitLA(codeBlock, level, offset));
 }
 
 void genLV(int level, int offset) {
-  emitLV(codeBlock, level, offset);
+  checkEmit(emitLV(codeBlock, level, offset));
 }
 
 void genLC(WORD constant) {
-  emitLC(codeBlock, constant);
+  checkEmit(emitLC(codeBlock, constant));
 }
 
 void genLI(void) {
-  emitLI(codeBlock);
+  Instruction* inst;
+
+  // LA p,q; LI  =>  LV p,q
+  if (canFuse(1)) {
+    inst = lastInstructions(1);
+    if (inst->op == OP_LA) {
+      inst->op = OP_LV;
+      return;
+    }
+  }
+
+  checkEmit(emitLI(codeBlock));
 }
 
 void genINT(int delta) {
-  emitINT(codeBlock,delta);
+  checkEmit(emitINT(codeBlock,delta));
 }
 
 void genDCT(int delta) {
-  emitDCT(codeBlock,delta);
+  checkEmit(emitDCT(codeBlock,delta));
 }
 
-Instruction* genJ(CodeAddress label) {
-  Instruction* inst = codeBlock->code + codeBlock->codeSize;
-  emitJ(codeBlock,label);
-  return inst;
+CodeAddress genJ(CodeAddress label) {
+  CodeAddress jmp = codeBlock->codeSize;
+  checkEmit(emitJ(codeBlock,label));
+  return jmp;
 }
 
-Instruction* genFJ(CodeAddress label) {
-  Instruction* inst = codeBlock->code + codeBlock->codeSize;
-  emitFJ(codeBlock, label);
-  return inst;
+// The false jumps: FEQ jumps when the operands differ, and so on
+CodeAddress genFEQ(CodeAddress label) {
+  CodeAddress jmp;
+
+  reduceModuloTest();
+  jmp = codeBlock->codeSize;
+  checkEmit(emitFEQ(codeBlock, label));
+  return jmp;
+}
+
+CodeAddress genFNE(CodeAddress label) {
+  CodeAddress jmp;
+
+  reduceModuloTest();
+  jmp = codeBlock->codeSize;
+  checkEmit(emitFNE(codeBlock, label));
+  return jmp;
+}
+
+CodeAddress genFGT(CodeAddress label) {
+  CodeAddress jmp = codeBlock->codeSize;
+  checkEmit(emitFGT(codeBlock, label));
+  return jmp;
+}
+
+CodeAddress genFLT(CodeAddress label) {
+  CodeAddress jmp = codeBlock->codeSize;
+  checkEmit(emitFLT(codeBlock, label));
+  return jmp;
+}
+
+CodeAddress genFGE(CodeAddress label) {
+  CodeAddress jmp = codeBlock->codeSize;
+  checkEmit(emitFGE(codeBlock, label));
+  return jmp;
+}
+
+CodeAddress genFLE(CodeAddress label) {
+  CodeAddress jmp = codeBlock->codeSize;
+  checkEmit(emitFLE(codeBlock, label));
+  return jmp;
+}
+
+CodeAddress genLOOP(int offset, CodeAddress label) {
+  CodeAddress jmp = codeBlock->codeSize;
+  checkEmit(emitLOOP(codeBlock, offset, label));
+  return jmp;
+}
+
+// Emit the instructions from start up to end once more; the copies keep their source positions
+void genCopy(CodeAddress start, CodeAddress end) {
+  Instruction inst;
+  int line, column;
+  CodeAddress i;
+
+  for (i = start; i < end; i ++) {
+    inst = codeBlock->code[i];
+    if (!emitCode(codeBlock, inst.op, inst.p, inst.q))
+      error(ERR_CODE_TOO_LARGE, currentToken->lineNo, currentToken->colNo);
+    if (findLine(codeBlock, i, &line, &column) &&
+	!addLine(codeBlock, codeBlock->codeSize - 1, line, column))
+      error(ERR_CODE_TOO_LARGE, currentToken->lineNo, currentToken->colNo);
+  }
+}
+
+// Repeat the condition from start up to its exit jump at test, then go back to label while it holds
+CodeAddress genLoopTest(CodeAddress start, CodeAddress test, CodeAddress label) {
+  // The false jump on the opposite test is taken when the condition holds
+  static enum OpCode opposite[] = { OP_FNE, OP_FEQ, OP_FLE, OP_FGE, OP_FLT, OP_FGT };
+  enum OpCode op = codeBlock->code[test].op;
+  CodeAddress jmp;
+
+  genCopy(start, test);
+  jmp = codeBlock->codeSize;
+  checkEmit(emitCode(codeBlock, opposite[op - OP_FEQ], DC_VALUE, label));
+  return jmp;
+}
+
+// Does the code from start up to end compute the same value wherever it runs in a
+// FOR loop over the local variable at offset? It may not read the counter or have effects.
+int isLoopInvariant(CodeAddress start, CodeAddress end, int offset) {
+  Instruction* inst;
+  CodeAddress i;
+
+  for (i = start; i < end; i ++) {
+    inst = codeBlock->code + i;
+    switch (inst->op) {
+    case OP_LC:
+    case OP_AD:
+    case OP_SB:
+    case OP_ML:
+    case OP_DV:
+    case OP_NEG:
+    case OP_MOD:
+    case OP_SHL:
+    case OP_SHR:
+    case OP_AND:
+      break;
+    case OP_LV:
+      if (isLocalValue(inst, offset)) return 0;
+      break;
+    case OP_ADV:
+      if ((inst->p == offset) || (inst->q == offset)) return 0;
+      break;
+    default:
+      return 0;
+    }
+  }
+  return 1;
 }
 
 void genHL(void) {
-  emitHL(codeBlock);
+  checkEmit(emitHL(codeBlock));
 }
 
 void genST(void) {
-  emitST(codeBlock);
+  checkEmit(emitST(codeBlock));
+}
+
+void genSTL(int level, int offset) {
+  Instruction* inst;
+
+  // LV 0,x; LC c; AD; STL 0,x  =>  INC x,c  (likewise c + x and x - c)
+  if ((level == 0) && canFuse(3)) {
+    inst = lastInstructions(3);
+    if ((inst[1].op == OP_LC) && isLocalValue(&inst[0], offset) &&
+	((inst[2].op == OP_AD) || (inst[2].op == OP_SB))) {
+      inst[0].op = OP_INC;
+      inst[0].p = offset;
+      inst[0].q = (inst[2].op == OP_AD) ? inst[1].q : (WORD) (0u - (unsigned) inst[1].q);
+      codeBlock->codeSize -= 2;
+      return;
+    }
+    if ((inst[0].op == OP_LC) && isLocalValue(&inst[1], offset) && (inst[2].op == OP_AD)) {
+      inst[0].op = OP_INC;
+      inst[0].p = offset;
+      codeBlock->codeSize -= 2;
+      return;
+    }
+  }
+
+  checkEmit(emitSTL(codeBlock, level, offset));
+}
+
+// Take back a trailing LA so that the caller can store with STL instead
+int takeVariableAddress(int* level, int* offset) {
+  Instruction* inst;
+
+  if (!canFuse(1)) return 0;
+  inst = lastInstructions(1);
+  if (inst->op != OP_LA) return 0;
+
+  *level = inst->p;
+  *offset = inst->q;
+  codeBlock->codeSize --;
+  return 1;
 }
 
 void genCALL(int level, CodeAddress label) {
-  emitCALL(codeBlock, level, label);
+  checkEmit(emitCALL(codeBlock, level, label));
 }
 
 void genEP(void) {
-  emitEP(codeBlock);
+  checkEmit(emitEP(codeBlock));
 }
 
 void genEF(void) {
-  emitEF(codeBlock);
+  checkEmit(emitEF(codeBlock));
 }
 
 void genRC(void) {
-  emitRC(codeBlock);
+  checkEmit(emitRC(codeBlock));
 }
 
 void genRI(void) {
-  emitRI(codeBlock);
+  checkEmit(emitRI(codeBlock));
 }
 
 void genWRC(void) {
-  emitWRC(codeBlock);
+  checkEmit(emitWRC(codeBlock));
 }
 
 void genWRI(void) {
-  emitWRI(codeBlock);
+  checkEmit(emitWRI(codeBlock));
 }
 
 void genWLN(void) {
-  emitWLN(codeBlock);
+  checkEmit(emitWLN(codeBlock));
 }
 
 void genAD(void) {
-  emitAD(codeBlock);
+  Instruction* inst;
+
+  if (foldArithmetic(OP_AD)) return;
+
+  if (canFuse(2)) {
+    inst = lastInstructions(2);
+    // LV 0,x; LV 0,y; AD  =>  ADV x,y
+    if ((inst[0].op == OP_LV) && (inst[0].p == 0) && (inst[1].op == OP_LV) && (inst[1].p == 0)) {
+      inst[0].op = OP_ADV;
+      inst[0].p = inst[0].q;
+      inst[0].q = inst[1].q;
+      codeBlock->codeSize --;
+      return;
+    }
+    // LA p,q; LC k; AD  =>  LA p,q+k  (a constant array index); never below the frame
+    if ((inst[0].op == OP_LA) && (inst[1].op == OP_LC) &&
+	(inst[1].q >= - inst[0].q) && (inst[1].q <= MAX_FRAME_SLOTS)) {
+      inst[0].q += inst[1].q;
+      codeBlock->codeSize --;
+      return;
+    }
+  }
+
+  checkEmit(emitAD(codeBlock));
 }
 
 void genSB(void) {
-  emitSB(codeBlock);
+  if (foldArithmetic(OP_SB) || reduceModulo()) return;
+  checkEmit(emitSB(codeBlock));
 }
 
 void genML(void) {
-  emitML(codeBlock);
+  if (foldArithmetic(OP_ML) || reduceStrength(OP_SHL)) return;
+  checkEmit(emitML(codeBlock));
 }
 
 void genDV(void) {
-  emitDV(codeBlock);
+  if (foldArithmetic(OP_DV) || reduceStrength(OP_SHR)) return;
+  checkEmit(emitDV(codeBlock));
 }
 
 void genNEG(void) {
-  emitNEG(codeBlock);
-}
+  Instruction* inst;
 
-void genCV(void) {
-  emitCV(codeBlock);
-}
+  // LC c; NEG  =>  LC -c
+  if (isFoldableConstant(1)) {
+    inst = lastInstructions(1);
+    inst->q = (WORD) (0u - (unsigned) inst->q);
+    return;
+  }
 
-void genEQ(void) {
-  emitEQ(codeBlock);
+  checkEmit(emitNEG(codeBlock));
 }
 
-void genNE(void) {
-  emitNE(codeBlock);
-}
-
-void genGT(void) {
-  emitGT(codeBlock);
+void genCV(void) {
+  checkEmit(emitCV(codeBlock));
 }
 
-void genGE(void) {
-  emitGE(codeBlock);
+// Jumps are referred to by address: the buffer may move while it grows
+void updateJ(CodeAddress jmp, CodeAddress label) {
+  codeBlock->code[jmp].q = label;
 }
 
-void genLT(void) {
-  emitLT(codeBlock);
+void updateFJ(CodeAddress jmp, CodeAddress label) {
+  codeBlock->code[jmp].q = label;
 }
 
-void genLE(void) {
-  emitLE(codeBlock);
+CodeAddress getCurrentCodeAddress(void) {
+  fusionBarrier = codeBlock->codeSize;
+  return codeBlock->codeSize;
 }
 
-void updateJ(Instruction* jmp, CodeAddress label) {
-  jmp->q = label;
+void setProgramEntry(Object* program) {
+  codeBlock->entry = program->progAttrs->codeAddress;
+  codeBlock->frameSize = PROGRAM_FRAME_SIZE(program);
 }
 
-void updateFJ(Instruction* jmp, CodeAddress label) {
-  jmp->q = label;
-}
 
-CodeAddress getCurrentCodeAddress(void) {
-  return codeBlock->codeSize;
+void initCodeBuffer(void) {
+  codeBlock = createCodeBlock(INITIAL_CODE_SIZE);
+  fusionBarrier = 0;
 }
 
-
-void initCodeBuffer(void) {
-  codeBlock = createCodeBlock(CODE_SIZE);
+void optimizeCodeBuffer(void) {
+  optimizeCode(codeBlock);
 }
 
 void printCodeBuffer(void) {
@@ -209,7 +581,25 @@ int serialize(char* fileName) {
 
   f = fopen(fileName, "wb");
   if (f == NULL) return IO_ERROR;
-  saveCode(codeBlock, f);
-  fclose(f);
+  if (writeExecutable(codeBlock, f) == IO_ERROR) {
+    fclose(f);
+    return IO_ERROR;
+  }
+  if (fclose(f) != 0) return IO_ERROR;
+  return IO_SUCCESS;
+}
+
+int serializeC(char* fileName, CodeAddress* errorAddress) {
+  FILE* f;
+  int status;
+
+  f = fopen(fileName, "w");
+  if (f == NULL) return IO_ERROR;
+  status = writeC(codeBlock, f, errorAddress);
+  if (status != IO_SUCCESS) {
+    fclose(f);
+    return status;
+  }
+  if (fclose(f) != 0) return IO_ERROR;
   return IO_SUCCESS;
 }
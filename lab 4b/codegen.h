@@ -10,8 +10,6 @@
 #include "symtab.h"
 #include "instructions.h"
 
-#define RESERVED_WORDS 4
-
 #define PROCEDURE_PARAM_COUNT(proc) (proc->procAttrs->numOfParams)
 #define PROCEDURE_SCOPE(proc) (proc->procAttrs->scope)
 #define PROCEDURE_FRAME_SIZE(proc) (proc->procAttrs->scope->frameSize)
@@ -29,10 +27,7 @@
 #define PARAMETER_OFFSET(param) (param->paramAttrs->localOffset)
 #define PARAMETER_SCOPE(param) (param->paramAttrs->scope)
 
-#define RETURN_VALUE_OFFSET 0
-#define DYNAMIC_LINK_OFFSET 1
-#define RETURN_ADDRESS_OFFSET 2
-#define STATIC_LINK_OFFSET 3
+int computeNestedLevel(Scope* scope);
 
 void genVariableAddress(Object* var);
 void genVariableValue(Object* var);
@@ -46,10 +41,20 @@ void genLC(WORD constant);
 void genLI(void);
 void genINT(int delta);
 void genDCT(int delta);
-Instruction* genJ(CodeAddress label);
-Instruction* genFJ(CodeAddress label);
+CodeAddress genJ(CodeAddress label);
+CodeAddress genFEQ(CodeAddress label);
+CodeAddress genFNE(CodeAddress label);
+CodeAddress genFGT(CodeAddress label);
+CodeAddress genFLT(CodeAddress label);
+CodeAddress genFGE(CodeAddress label);
+CodeAddress genFLE(CodeAddress label);
+CodeAddress genLOOP(int offset, CodeAddress label);
+void genCopy(CodeAddress start, CodeAddress end);
+CodeAddress genLoopTest(CodeAddress start, CodeAddress test, CodeAddress label);
+int isLoopInvariant(CodeAddress start, CodeAddress end, int offset);
 void genHL(void);
 void genST(void);
+void genSTL(int level, int offset);
 void genCALL(int level, CodeAddress label);
 void genEP(void);
 void genEF(void);
@@ -64,24 +69,24 @@ void genML(void);
 void genDV(void);
 void genNEG(void);
 void genCV(void);
-void genEQ(void);
-void genNE(void);
-void genGT(void);
-void genGE(void);
-void genLT(void);
-void genLE(void);
 
-void updateJ(Instruction* jmp, CodeAddress label);
-void updateFJ(Instruction* jmp, CodeAddress label);
+int takeVariableAddress(int* level, int* offset);
+
+void updateJ(CodeAddress jmp, CodeAddress label);
+void updateFJ(CodeAddress jmp, CodeAddress label);
 
 CodeAddress getCurrentCodeAddress(void);
+void setProgramEntry(Object* program);
 int isPredefinedProcedure(Object* proc);
 int isPredefinedFunction(Object* func);
 
 void initCodeBuffer(void);
+void optimizeCodeBuffer(void);
 void printCodeBuffer(void);
 void cleanCodeBuffer(void);
 
 int serialize(char* fileName);
+// IO_INVALID_CODE or IO_INVALID_INSTRUCTION if the verifier rejects the code
+int serializeC(char* fileName, CodeAddress* errorAddress);
 
 #endif
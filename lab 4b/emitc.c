@@ -0,0 +1,293 @@
+/*
+ * @copyright (c) 2008, Hedspi, Hanoi University of Technology
+ * @author Huu-Duc Nguyen
+ * @version 1.0
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "reader.h"
+#include "emitc.h"
+#include "verify.h"
+
+static CodeBlock* block;
+static Verification* verification;
+
+/******************* Fixed parts of the program ******************************/
+
+static const char* prologue =
+  "#include <stdio.h>\n"
+  "#include <stdlib.h>\n"
+  "\n"
+  "typedef int WORD;\n"
+  "\n"
+  "static WORD* s;\n"
+  "static WORD display[MAX_DEPTH + 1];\n"
+  "static struct { WORD entry; int level; } links[MAX_DEPTH];\n"
+  "\n"
+  "#define PUSH(n, a) do { if (t + (n) >= STACK_SIZE) { pc = (a); goto stackOverflow; } } while (0)\n"
+  "#define CHECK(x, a) do { if ((unsigned) (x) >= (unsigned) STACK_SIZE) { pc = (a); goto badAddress; } } while (0)\n"
+  "#define LEVEL(p, a) do { if ((unsigned) (p) > (unsigned) level) { pc = (a); goto badAddress; } } while (0)\n"
+  "#define ENTER(p, a) do { if (depth == MAX_DEPTH) { pc = (a); goto stackOverflow; } "
+  "links[depth].level = level; level += 1 - (p); links[depth].entry = display[level]; depth ++; display[level] = b; } while (0)\n"
+  "#define LEAVE(a) do { if (depth == 0) { pc = (a); goto badAddress; } "
+  "depth --; display[level] = links[depth].entry; level = links[depth].level; } while (0)\n"
+  "\n"
+  "int main(void) {\n"
+  "  int t = -1;\n"
+  "  int b = 0;\n"
+  "  int level = 0;\n"
+  "  int depth = 0;\n"
+  "  int pc = 0;\n"
+  "  int x;\n"
+  "  int link;\n"
+  "  const char* message;\n"
+  "\n"
+  "  s = (WORD*) calloc(STACK_SIZE, sizeof(WORD));\n"
+  "  if (s == NULL) return -1;\n";
+
+static const char* epilogue =
+  " halt:\n"
+  "  if ((fflush(stdout) == 0) && !ferror(stdout)) return 0;\n"
+  "  message = \"I/O error.\";\n"
+  "  goto error;\n"
+  "\n"
+  " stackOverflow:\n"
+  "  message = \"Stack overflow.\";\n"
+  "  goto error;\n"
+  " divideByZero:\n"
+  "  message = \"Division by zero.\";\n"
+  "  goto error;\n"
+  " badAddress:\n"
+  "  message = \"Invalid address.\";\n"
+  "  goto error;\n"
+  " ioError:\n"
+  "  message = \"I/O error.\";\n"
+  "  goto error;\n"
+  " error:\n"
+  "  fflush(stdout);\n"
+  "  fprintf(stderr, \"%d: %s\\n\", pc, message);\n"
+  "  return -1;\n"
+  "}\n";
+
+/******************* Instructions ******************************/
+
+// The frame p static links up, written so that level 0 costs nothing
+static void writeBase(FILE* f, WORD p) {
+  if (p == 0) fprintf(f, "b");
+  else fprintf(f, "display[level - %d]", p);
+}
+
+static void writeLevelCheck(FILE* f, CodeAddress pc, WORD p) {
+  if (p != 0) fprintf(f, "LEVEL(%d, %d); ", p, pc);
+}
+
+static void writeJump(FILE* f, CodeAddress label) {
+  if ((label >= 0) && (label < block->codeSize))
+    fprintf(f, "goto L%d;", label);
+  else
+    fprintf(f, "{ pc = %d; goto badAddress; }", label);
+}
+
+static void writeInstruction(FILE* f, CodeAddress pc, Instruction* inst) {
+  static const char* compare[] = { "==", "!=", ">", "<", ">=", "<=" };
+  static const char* arithmetic[] = { "+", "-", "*" };
+
+  fprintf(f, " L%d: ", pc);
+
+  switch (inst->op) {
+  case OP_LA:
+    fprintf(f, "PUSH(1, %d); ", pc);
+    writeLevelCheck(f, pc, inst->p);
+    fprintf(f, "s[++t] = ");
+    writeBase(f, inst->p);
+    fprintf(f, " + %d;", inst->q);
+    break;
+  case OP_LV:
+    fprintf(f, "PUSH(1, %d); ", pc);
+    writeLevelCheck(f, pc, inst->p);
+    fprintf(f, "x = ");
+    writeBase(f, inst->p);
+    fprintf(f, " + %d; CHECK(x, %d); s[++t] = s[x];", inst->q, pc);
+    break;
+  case OP_LC:
+    fprintf(f, "PUSH(1, %d); s[++t] = %d;", pc, inst->q);
+    break;
+  case OP_LI:
+    fprintf(f, "CHECK(s[t], %d); s[t] = s[s[t]];", pc);
+    break;
+  case OP_INT:
+    fprintf(f, "PUSH(%d, %d); t += %d;", inst->q, pc, inst->q);
+    break;
+  case OP_DCT:
+    fprintf(f, "t -= %d;", inst->q);
+    break;
+  case OP_J:
+    writeJump(f, inst->q);
+    break;
+  case OP_FJ:
+    fprintf(f, "if (s[t--] == 0) ");
+    writeJump(f, inst->q);
+    break;
+  case OP_HL:
+    fprintf(f, "pc = %d; goto halt;", pc);
+    break;
+  case OP_ST:
+    fprintf(f, "CHECK(s[t-1], %d); s[s[t-1]] = s[t]; t -= 2;", pc);
+    break;
+  case OP_CALL:
+    // The whole frame of the callee, checked where kplrun checks it
+    fprintf(f, "PUSH(%d, %d); ", verification->limit[inst->q] + 1, pc);
+    writeLevelCheck(f, pc, inst->p);
+    fprintf(f, "s[t+%d] = b; s[t+%d] = %d; s[t+%d] = ",
+	    1 + DYNAMIC_LINK_OFFSET, 1 + RETURN_ADDRESS_OFFSET, pc + 1, 1 + STATIC_LINK_OFFSET);
+    writeBase(f, inst->p);
+    fprintf(f, "; b = t + 1; ENTER(%d, %d); ", inst->p, pc);
+    writeJump(f, inst->q);
+    break;
+  case OP_EP:
+  case OP_EF:
+    // The links are checked as the stack interpreter checks them, at the return
+    fprintf(f, "pc = %d; link = s[b+%d]; if ((unsigned) link > (unsigned) b) goto badAddress; ",
+	    pc, DYNAMIC_LINK_OFFSET);
+    fprintf(f, "LEAVE(%d); t = b%s; x = s[b+%d]; b = link; goto ret;", pc,
+	    (inst->op == OP_EP) ? " - 1" : "", RETURN_ADDRESS_OFFSET);
+    break;
+  case OP_RC:
+    fprintf(f, "PUSH(1, %d); x = getchar(); if (x == EOF) { pc = %d; goto ioError; } s[++t] = x;", pc, pc);
+    break;
+  case OP_RI:
+    fprintf(f, "PUSH(1, %d); if (scanf(\"%%d\", &x) != 1) { pc = %d; goto ioError; } s[++t] = x;", pc, pc);
+    break;
+  case OP_WRC:
+    fprintf(f, "putchar(s[t--]);");
+    break;
+  case OP_WRI:
+    fprintf(f, "printf(\"%%d\", s[t--]);");
+    break;
+  case OP_WLN:
+    fprintf(f, "putchar('\\n');");
+    break;
+  case OP_AD:
+  case OP_SB:
+  case OP_ML:
+    fprintf(f, "t --; s[t] %s= s[t+1];", arithmetic[inst->op - OP_AD]);
+    break;
+  case OP_DV:
+    fprintf(f, "t --; if (s[t+1] == 0) { pc = %d; goto divideByZero; } "
+	    "if (s[t+1] == -1) s[t] = - s[t]; else s[t] /= s[t+1];", pc);
+    break;
+  case OP_NEG:
+    fprintf(f, "s[t] = - s[t];");
+    break;
+  case OP_CV:
+    fprintf(f, "PUSH(1, %d); s[t+1] = s[t]; t ++;", pc);
+    break;
+  case OP_EQ:
+  case OP_NE:
+  case OP_GT:
+  case OP_LT:
+  case OP_GE:
+  case OP_LE:
+    fprintf(f, "t --; s[t] = (s[t] %s s[t+1]);", compare[inst->op - OP_EQ]);
+    break;
+  case OP_BP:
+    fprintf(f, ";");
+    break;
+  case OP_ADV:
+    fprintf(f, "PUSH(1, %d); CHECK(b + %d, %d); CHECK(b + %d, %d); t ++; s[t] = s[b + %d] + s[b + %d];",
+	    pc, inst->p, pc, inst->q, pc, inst->p, inst->q);
+    break;
+  case OP_INC:
+    fprintf(f, "CHECK(b + %d, %d); s[b + %d] += %d;", inst->p, pc, inst->p, inst->q);
+    break;
+  case OP_STL:
+    writeLevelCheck(f, pc, inst->p);
+    fprintf(f, "x = ");
+    writeBase(f, inst->p);
+    fprintf(f, " + %d; CHECK(x, %d); s[x] = s[t--];", inst->q, pc);
+    break;
+  case OP_FEQ:
+  case OP_FNE:
+  case OP_FGT:
+  case OP_FLT:
+  case OP_FGE:
+  case OP_FLE:
+    fprintf(f, "t -= 2; if (!(s[t+1] %s s[t+2])) ", compare[inst->op - OP_FEQ]);
+    writeJump(f, inst->q);
+    break;
+  case OP_MOD:
+    fprintf(f, "t --; if (s[t+1] == 0) { pc = %d; goto divideByZero; } "
+	    "if (s[t+1] == -1) s[t] = 0; else s[t] %%= s[t+1];", pc);
+    break;
+  case OP_SHL:
+    fprintf(f, "s[t] = (int) ((unsigned) s[t] << %d);", inst->q);
+    break;
+  case OP_SHR:
+    // The C compiler turns the division by a power of two back into shifts
+    fprintf(f, "s[t] /= %d;", 1 << inst->q);
+    break;
+  case OP_AND:
+    fprintf(f, "s[t] &= %d;", inst->q);
+    break;
+  case OP_LOOP:
+    fprintf(f, "t --; CHECK(b + %d, %d); if (++ s[b + %d] <= s[t+1]) ", inst->p, pc, inst->p);
+    writeJump(f, inst->q);
+    break;
+  }
+  fprintf(f, "\n");
+}
+
+/******************************************************************/
+
+char* invalidCodeToString(int status) {
+  return (status == IO_INVALID_INSTRUCTION) ? "Invalid instruction." : "Invalid code.";
+}
+
+int writeC(CodeBlock* codeBlock, FILE* f, CodeAddress* errorAddress) {
+  int returns = 0;
+  int i;
+
+  block = codeBlock;
+  verification = verifyCode(codeBlock, errorAddress);
+  if (verification == NULL) {
+    // Told apart as loadProgram does
+    if ((*errorAddress < codeBlock->codeSize) && ((unsigned) codeBlock->code[*errorAddress].op > MAX_OPCODE))
+      return IO_INVALID_INSTRUCTION;
+    return IO_INVALID_CODE;
+  }
+  for (i = 0; i < codeBlock->codeSize; i ++)
+    if ((codeBlock->code[i].op == OP_EP) || (codeBlock->code[i].op == OP_EF)) returns = 1;
+
+  fprintf(f, "/* Generated by kplc */\n\n#define STACK_SIZE %d\n#define MAX_DEPTH %d\n\n",
+	  C_STACK_SIZE, C_STACK_SIZE / RESERVED_WORDS + 1);
+  fprintf(f, "%s", prologue);
+  fprintf(f, "  if (%d >= STACK_SIZE) { pc = %d; goto stackOverflow; }\n",
+	  verification->limit[codeBlock->entry], codeBlock->entry);
+  fprintf(f, "  ");
+  writeJump(f, codeBlock->entry);
+  fprintf(f, "\n\n");
+
+  for (i = 0; i < codeBlock->codeSize; i ++)
+    writeInstruction(f, i, codeBlock->code + i);
+  fprintf(f, "  pc = %d; goto badAddress;\n\n", codeBlock->codeSize);
+
+  // Return addresses are stack words: map them back to labels, and only
+  // resume a caller whose frame has the height it had at the call. A
+  // call the verifier never reached cannot have pushed its address.
+  if (returns) {
+    fprintf(f, " ret:\n  switch (x) {\n");
+    for (i = 0; i < codeBlock->codeSize; i ++)
+      if ((codeBlock->code[i].op == OP_CALL) && (i + 1 < codeBlock->codeSize)
+	  && (verification->height[i] != UNREACHED)) {
+	fprintf(f, "  case %d: if (t - b != %d) goto badAddress; ", i + 1, verification->height[i + 1]);
+	fprintf(f, "if (b + %d >= STACK_SIZE) goto stackOverflow; goto L%d;\n",
+		verification->limit[i + 1], i + 1);
+      }
+    fprintf(f, "  default: goto badAddress;\n  }\n\n");
+  }
+
+  fprintf(f, "%s", epilogue);
+  freeVerification(verification);
+  return ferror(f) ? IO_ERROR : IO_SUCCESS;
+}
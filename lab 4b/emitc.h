@@ -0,0 +1,31 @@
+/*
+ * @copyright (c) 2008, Hedspi, Hanoi University of Technology
+ * @author Huu-Duc Nguyen
+ * @version 1.0
+ */
+
+#ifndef __EMITC_H__
+#define __EMITC_H__
+
+#include <stdio.h>
+#include "instructions.h"
+
+#define C_STACK_SIZE 1048576
+
+// writeC fails with these, besides IO_ERROR, when the verifier rejects the code
+#define IO_INVALID_CODE 2
+#define IO_INVALID_INSTRUCTION 3
+
+/*
+ * Write a code block as one self-contained C program. Every address
+ * becomes a label and s, t and b become variables of main(), so an
+ * optimizing C compiler sees the whole program at once. Run-time errors
+ * are reported the way kplrun reports them. Code the verifier rejects
+ * is not written: *errorAddress then tells where, as kplrun would.
+ */
+int writeC(CodeBlock* codeBlock, FILE* f, CodeAddress* errorAddress);
+
+// The message kplrun gives for IO_INVALID_CODE or IO_INVALID_INSTRUCTION
+char* invalidCodeToString(int status);
+
+#endif
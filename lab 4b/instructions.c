@@ -5,7 +5,17 @@
  */
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+#include "reader.h"
 #include "instructions.h"
+#include "kplb.h"
 
 #define MAX_BLOCK 50
 
@@ -15,19 +25,104 @@ CodeBlock* createCodeBlock(int maxSize) {
   codeBlock->code = (Instruction*) malloc(maxSize * sizeof(Instruction));
   codeBlock->codeSize = 0;
   codeBlock->maxSize = maxSize;
+  codeBlock->entry = 0;
+  codeBlock->frameSize = 0;
+  codeBlock->mappedSize = 0;
+  codeBlock->lines = NULL;
+  codeBlock->lineCount = 0;
+  codeBlock->maxLineCount = 0;
   return codeBlock;
 }
 
 void freeCodeBlock(CodeBlock* codeBlock) {
-  free(codeBlock->code);
+#ifndef _WIN32
+  if (codeBlock->mappedSize > 0)
+    munmap(codeBlock->code, codeBlock->mappedSize);
+  else
+#endif
+    free(codeBlock->code);
+  free(codeBlock->lines);
   free(codeBlock);
 }
 
+// Twice size, or 0 when that no longer fits in an int or in a size_t worth of bytes
+static int doubleSize(int size, size_t elementSize) {
+  if (size <= 0) return MAX_BLOCK;
+  if ((size > INT_MAX / 2) || ((size_t) size > ((size_t) -1) / 2 / elementSize)) return 0;
+  return size * 2;
+}
+
+// Double the capacity so that a run of emits costs amortized O(1) each
+static int growCodeBlock(CodeBlock* codeBlock) {
+  Instruction* code;
+  int maxSize = doubleSize(codeBlock->maxSize, sizeof(Instruction));
+
+  if (codeBlock->mappedSize > 0) return 0;
+  if (maxSize == 0) return 0;
+
+  code = (Instruction*) realloc(codeBlock->code, maxSize * sizeof(Instruction));
+  if (code == NULL) return 0;
+
+  codeBlock->code = code;
+  codeBlock->maxSize = maxSize;
+  return 1;
+}
+
+int addLine(CodeBlock* codeBlock, CodeAddress address, int line, int column) {
+  LineEntry* lines;
+  LineEntry* last;
+  int maxCount;
+
+  // Code may have been taken back since: its positions go with it
+  while ((codeBlock->lineCount > 0) && (codeBlock->lines[codeBlock->lineCount - 1].address >= address))
+    codeBlock->lineCount --;
+
+  if (codeBlock->lineCount > 0) {
+    last = codeBlock->lines + codeBlock->lineCount - 1;
+    if ((last->line == line) && (last->column == column)) return 1;
+  }
+
+  if (codeBlock->lineCount >= codeBlock->maxLineCount) {
+    maxCount = doubleSize(codeBlock->maxLineCount, sizeof(LineEntry));
+    if (maxCount == 0) return 0;
+    lines = (LineEntry*) realloc(codeBlock->lines, maxCount * sizeof(LineEntry));
+    if (lines == NULL) return 0;
+    codeBlock->lines = lines;
+    codeBlock->maxLineCount = maxCount;
+  }
+
+  last = codeBlock->lines + codeBlock->lineCount ++;
+  last->address = address;
+  last->line = line;
+  last->column = column;
+  return 1;
+}
+
+int findLine(CodeBlock* codeBlock, CodeAddress address, int* line, int* column) {
+  int low = 0, high = codeBlock->lineCount - 1;
+  int middle;
+
+  if ((address < 0) || (address >= codeBlock->codeSize)) return 0;
+  if ((high < 0) || (codeBlock->lines[0].address > address)) return 0;
+
+  // The last entry at or below address
+  while (low < high) {
+    middle = (low + high + 1) / 2;
+    if (codeBlock->lines[middle].address <= address) low = middle;
+    else high = middle - 1;
+  }
+  *line = codeBlock->lines[low].line;
+  *column = codeBlock->lines[low].column;
+  return 1;
+}
+
 int emitCode(CodeBlock* codeBlock, enum OpCode op, WORD p, WORD q) {
-  Instruction* bottom = codeBlock->code + codeBlock->codeSize;
+  Instruction* bottom;
 
-  if (codeBlock->codeSize >= codeBlock->maxSize) return 0;
+  if ((codeBlock->codeSize >= codeBlock->maxSize) && !growCodeBlock(codeBlock))
+    return 0;
 
+  bottom = codeBlock->code + codeBlock->codeSize;
   bottom->op = op;
   bottom->p = p;
   bottom->q = q;
@@ -68,45 +163,84 @@ int emitLE(CodeBlock* codeBlock) { return emitCode(codeBlock, OP_LE, DC_VALUE, D
 
 int emitBP(CodeBlock* codeBlock) { return emitCode(codeBlock, OP_BP, DC_VALUE, DC_VALUE); }
 
+int emitADV(CodeBlock* codeBlock, WORD p, WORD q) { return emitCode(codeBlock, OP_ADV, p, q); }
+int emitINC(CodeBlock* codeBlock, WORD p, WORD q) { return emitCode(codeBlock, OP_INC, p, q); }
+int emitSTL(CodeBlock* codeBlock, WORD p, WORD q) { return emitCode(codeBlock, OP_STL, p, q); }
 
-void printInstruction(Instruction* inst) {
-  switch (inst->op) {
-  case OP_LA: printf("LA %d,%d", inst->p, inst->q); break;
-  case OP_LV: printf("LV %d,%d", inst->p, inst->q); break;
-  case OP_LC: printf("LC %d", inst->q); break;
-  case OP_LI: printf("LI"); break;
-  case OP_INT: printf("INT %d", inst->q); break;
-  case OP_DCT: printf("DCT %d", inst->q); break;
-  case OP_J: printf("J %d", inst->q); break;
-  case OP_FJ: printf("FJ %d", inst->q); break;
-  case OP_HL: printf("HL"); break;
-  case OP_ST: printf("ST"); break;
-  case OP_CALL: printf("CALL %d,%d", inst->p, inst->q); break;
-  case OP_EP: printf("EP"); break;
-  case OP_EF: printf("EF"); break;
-  case OP_RC: printf("RC"); break;
-  case OP_RI: printf("RI"); break;
-  case OP_WRC: printf("WRC"); break;
-  case OP_WRI: printf("WRI"); break;
-  case OP_WLN: printf("WLN"); break;
-  case OP_AD: printf("AD"); break;
-  case OP_SB: printf("SB"); break;
-  case OP_ML: printf("ML"); break;
-  case OP_DV: printf("DV"); break;
-  case OP_NEG: printf("NEG"); break;
-  case OP_CV: printf("CV"); break;
-  case OP_EQ: printf("EQ"); break;
-  case OP_NE: printf("NE"); break;
-  case OP_GT: printf("GT"); break;
-  case OP_LT: printf("LT"); break;
-  case OP_GE: printf("GE"); break;
-  case OP_LE: printf("LE"); break;
-
-  case OP_BP: printf("BP"); break;
-  default: break;
+int emitFEQ(CodeBlock* codeBlock, WORD q) { return emitCode(codeBlock, OP_FEQ, DC_VALUE, q); }
+int emitFNE(CodeBlock* codeBlock, WORD q) { return emitCode(codeBlock, OP_FNE, DC_VALUE, q); }
+int emitFGT(CodeBlock* codeBlock, WORD q) { return emitCode(codeBlock, OP_FGT, DC_VALUE, q); }
+int emitFLT(CodeBlock* codeBlock, WORD q) { return emitCode(codeBlock, OP_FLT, DC_VALUE, q); }
+int emitFGE(CodeBlock* codeBlock, WORD q) { return emitCode(codeBlock, OP_FGE, DC_VALUE, q); }
+int emitFLE(CodeBlock* codeBlock, WORD q) { return emitCode(codeBlock, OP_FLE, DC_VALUE, q); }
+
+int emitMOD(CodeBlock* codeBlock) { return emitCode(codeBlock, OP_MOD, DC_VALUE, DC_VALUE); }
+int emitSHL(CodeBlock* codeBlock, WORD q) { return emitCode(codeBlock, OP_SHL, DC_VALUE, q); }
+int emitSHR(CodeBlock* codeBlock, WORD q) { return emitCode(codeBlock, OP_SHR, DC_VALUE, q); }
+int emitAND(CodeBlock* codeBlock, WORD q) { return emitCode(codeBlock, OP_AND, DC_VALUE, q); }
+
+int emitLOOP(CodeBlock* codeBlock, WORD p, WORD q) { return emitCode(codeBlock, OP_LOOP, p, q); }
+
+int operandsOf(enum OpCode op) {
+  switch (op) {
+  case OP_LA:
+  case OP_LV:
+  case OP_CALL:
+  case OP_ADV:
+  case OP_INC:
+  case OP_STL:
+  case OP_LOOP:
+    return OPERAND_P | OPERAND_Q;
+  case OP_LC:
+  case OP_INT:
+  case OP_DCT:
+  case OP_J:
+  case OP_FJ:
+  case OP_FEQ:
+  case OP_FNE:
+  case OP_FGT:
+  case OP_FLT:
+  case OP_FGE:
+  case OP_FLE:
+  case OP_SHL:
+  case OP_SHR:
+  case OP_AND:
+    return OPERAND_Q;
+  default:
+    return 0;
   }
 }
 
+const char* opCodeName(enum OpCode op) {
+  static const char* names[] = {
+    "LA", "LV", "LC", "LI", "INT", "DCT",
+    "J", "FJ", "HL", "ST", "CALL", "EP", "EF",
+    "RC", "RI", "WRC", "WRI", "WLN",
+    "AD", "SB", "ML", "DV", "NEG", "CV",
+    "EQ", "NE", "GT", "LT", "GE", "LE",
+    "BP",
+    "ADV", "INC", "STL",
+    "FEQ", "FNE", "FGT", "FLT", "FGE", "FLE",
+    "MOD", "SHL", "SHR", "AND",
+    "LOOP"
+  };
+
+  if ((unsigned) op > MAX_OPCODE) return "";
+  return names[op];
+}
+
+void fprintInstruction(FILE* f, Instruction* inst) {
+  int operands = operandsOf(inst->op);
+
+  fprintf(f, "%s", opCodeName(inst->op));
+  if (operands & OPERAND_P) fprintf(f, " %d,%d", inst->p, inst->q);
+  else if (operands & OPERAND_Q) fprintf(f, " %d", inst->q);
+}
+
+void printInstruction(Instruction* inst) {
+  fprintInstruction(stdout, inst);
+}
+
 void printCodeBlock(CodeBlock* codeBlock) {
   Instruction* pc = codeBlock->code;
   int i;
@@ -119,19 +253,113 @@ void printCodeBlock(CodeBlock* codeBlock) {
 }
 
 
-void loadCode(CodeBlock* codeBlock, FILE* f) {
+int loadCode(CodeBlock* codeBlock, FILE* f) {
   Instruction* code = codeBlock->code;
-  int n;
+  int n, count;
 
   codeBlock->codeSize = 0;
-  while (!feof(f)) {
-    n = fread(code, sizeof(Instruction), MAX_BLOCK, f);
+  while (codeBlock->codeSize < codeBlock->maxSize) {
+    count = codeBlock->maxSize - codeBlock->codeSize;
+    if (count > MAX_BLOCK) count = MAX_BLOCK;
+    n = fread(code, sizeof(Instruction), count, f);
+    if (n == 0) break;
     code += n;
     codeBlock->codeSize += n;
   }
+
+  // The image must fit in the block and end on an instruction boundary
+  if (ferror(f) || (getc(f) != EOF))
+    return IO_ERROR;
+  return IO_SUCCESS;
 }
 
 
 void saveCode(CodeBlock* codeBlock, FILE* f) {
   fwrite(codeBlock->code, sizeof(Instruction), codeBlock->codeSize, f);
 }
+
+#ifndef _WIN32
+
+/*
+ * Map the file read-only. A .kplb executable is decoded straight out of
+ * the mapping; a raw instruction dump from older compilers is executed
+ * in place, without copying.
+ */
+CodeBlock* mapCode(char* fileName) {
+  CodeBlock* codeBlock;
+  struct stat st;
+  void* mapping;
+  int fd;
+
+  fd = open(fileName, O_RDONLY);
+  if (fd < 0) return NULL;
+
+  if ((fstat(fd, &st) != 0) || (st.st_size == 0) || (st.st_size > 0x7fffffff)) {
+    close(fd);
+    return NULL;
+  }
+
+  mapping = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (mapping == MAP_FAILED) return NULL;
+
+  if (isExecutable((unsigned char*) mapping, st.st_size)) {
+    codeBlock = readExecutable((unsigned char*) mapping, st.st_size);
+    munmap(mapping, st.st_size);
+    return codeBlock;
+  }
+
+  if (st.st_size % sizeof(Instruction) != 0) {
+    munmap(mapping, st.st_size);
+    return NULL;
+  }
+
+  codeBlock = (CodeBlock*) malloc(sizeof(CodeBlock));
+  codeBlock->code = (Instruction*) mapping;
+  codeBlock->codeSize = st.st_size / sizeof(Instruction);
+  codeBlock->maxSize = codeBlock->codeSize;
+  codeBlock->entry = 0;
+  codeBlock->frameSize = 0;
+  codeBlock->mappedSize = st.st_size;
+  codeBlock->lines = NULL;
+  codeBlock->lineCount = 0;
+  codeBlock->maxLineCount = 0;
+  return codeBlock;
+}
+
+#else
+
+// No mmap here: fall back to reading the whole file onto the heap
+CodeBlock* mapCode(char* fileName) {
+  CodeBlock* codeBlock = NULL;
+  unsigned char* data;
+  FILE* f;
+  long size;
+
+  f = fopen(fileName, "rb");
+  if (f == NULL) return NULL;
+
+  fseek(f, 0, SEEK_END);
+  size = ftell(f);
+  fseek(f, 0, SEEK_SET);
+  if (size <= 0) {
+    fclose(f);
+    return NULL;
+  }
+
+  data = (unsigned char*) malloc(size);
+  if (fread(data, 1, size, f) == (size_t) size) {
+    if (isExecutable(data, size))
+      codeBlock = readExecutable(data, size);
+    else if (size % sizeof(Instruction) == 0) {
+      codeBlock = createCodeBlock(size / sizeof(Instruction));
+      memcpy(codeBlock->code, data, size);
+      codeBlock->codeSize = codeBlock->maxSize;
+    }
+  }
+  free(data);
+  fclose(f);
+  return codeBlock;
+}
+
+#endif
@@ -15,6 +15,14 @@
 #define INT_SIZE 1
 #define CHAR_SIZE 1
 
+// Layout of the reserved words at the bottom of every stack frame
+#define RESERVED_WORDS 4
+
+#define RETURN_VALUE_OFFSET 0
+#define DYNAMIC_LINK_OFFSET 1
+#define RETURN_ADDRESS_OFFSET 2
+#define STATIC_LINK_OFFSET 3
+
 typedef int WORD;
 
 enum OpCode {
@@ -31,8 +39,8 @@ enum OpCode {
   OP_CALL, // Call             s[t+2] := b; s[t+3] := pc; s[t+4]:= base(p); b:=t+1; pc:=q;
   OP_EP,   // Exit Procedure   t := b - 1;  pc := s[b+2];  b := s[b+1];
   OP_EF,   // Exit Function    t := b;  pc := s[b+2];  b := s[b+1];
-  OP_RC,   // Read Char        read one character into s[s[t]];  t := t - 1;
-  OP_RI,   // Read Integer     read integer to s[s[t]];  t := t-1;
+  OP_RC,   // Read Char        t := t + 1;  read one character into s[t];
+  OP_RI,   // Read Integer     t := t + 1;  read integer into s[t];
   OP_WRC,  // Write Char       write one character from s[t];  t := t-1;
   OP_WRI,  // Write Int        write integer from s[t];  t := t-1;
   OP_WLN,  // WriteLN          CR/LF
@@ -49,9 +57,34 @@ enum OpCode {
   OP_GE,   // Greater or Equal t := t - 1;  if s[t] >= s[t+1] then s[t] := 1 else s[t] := 0;
   OP_LE,   // Less or Equal    t := t - 1;  if s[t] >= s[t+1] then s[t] := 1 else s[t] := 0;
 
-  OP_BP    // Break point. Just for debugging
+  OP_BP,   // Break point. Just for debugging
+
+  // Superinstructions: each replaces a sequence the code generator emits often
+  OP_ADV,  // Add Values       t := t + 1; s[t] := s[b + p] + s[b + q];
+  OP_INC,  // Increment        s[b + p] := s[b + p] + q;
+  OP_STL,  // Store Local      s[base(p) + q] := s[t]; t := t - 1;
+  OP_FEQ,  // False Jump EQ    t := t - 2; if s[t+1] != s[t+2] then pc := q;
+  OP_FNE,  // False Jump NE    t := t - 2; if s[t+1] = s[t+2] then pc := q;
+  OP_FGT,  // False Jump GT    t := t - 2; if s[t+1] <= s[t+2] then pc := q;
+  OP_FLT,  // False Jump LT    t := t - 2; if s[t+1] >= s[t+2] then pc := q;
+  OP_FGE,  // False Jump GE    t := t - 2; if s[t+1] < s[t+2] then pc := q;
+  OP_FLE,  // False Jump LE    t := t - 2; if s[t+1] > s[t+2] then pc := q;
+
+  // Strength reduced arithmetic
+  OP_MOD,  // Modulo           t := t-1;  s[t] := s[t] - (s[t] / s[t+1]) * s[t+1];
+  OP_SHL,  // Shift Left       s[t] := s[t] * 2^q;
+  OP_SHR,  // Shift Right      s[t] := s[t] / 2^q;  rounded toward 0 like DV
+  OP_AND,  // And Mask         s[t] := s[t] & q;
+
+  OP_LOOP  // Counted Loop     t := t - 1; s[b + p] := s[b + p] + 1; if s[b + p] <= s[t+1] then pc := q;
 };
 
+// Opcodes above this value are invalid
+#define MAX_OPCODE OP_LOOP
+
+// Largest shift count: 2^q must be a positive WORD
+#define MAX_SHIFT 30
+
 struct Instruction_ {
   enum OpCode op;
   WORD p;
@@ -61,14 +94,36 @@ struct Instruction_ {
 typedef struct Instruction_ Instruction;
 typedef int CodeAddress;
 
+// Source position of the instructions from address up to the next entry
+struct LineEntry_ {
+  CodeAddress address;
+  int line;
+  int column;
+};
+
+typedef struct LineEntry_ LineEntry;
+
 struct CodeBlock_ {
   Instruction* code;
   int codeSize;
   int maxSize;
+
+  CodeAddress entry;       // address where execution starts
+  int frameSize;           // size of the main program's stack frame
+
+  long mappedSize;         // length of the file mapping behind code, 0 if code is on the heap
+
+  LineEntry* lines;        // by increasing address; NULL when the image has no line table
+  int lineCount;
+  int maxLineCount;
 };
 
 typedef struct CodeBlock_ CodeBlock;
 
+// Operands an instruction actually uses; the others are DC_VALUE
+#define OPERAND_P 1
+#define OPERAND_Q 2
+
 CodeBlock* createCodeBlock(int maxSize);
 void freeCodeBlock(CodeBlock* codeBlock);
 
@@ -107,10 +162,39 @@ int emitLE(CodeBlock* codeBlock);
 
 int emitBP(CodeBlock* codeBlock);
 
+int emitADV(CodeBlock* codeBlock, WORD p, WORD q);
+int emitINC(CodeBlock* codeBlock, WORD p, WORD q);
+int emitSTL(CodeBlock* codeBlock, WORD p, WORD q);
+
+int emitFEQ(CodeBlock* codeBlock, WORD q);
+int emitFNE(CodeBlock* codeBlock, WORD q);
+int emitFGT(CodeBlock* codeBlock, WORD q);
+int emitFLT(CodeBlock* codeBlock, WORD q);
+int emitFGE(CodeBlock* codeBlock, WORD q);
+int emitFLE(CodeBlock* codeBlock, WORD q);
+
+int emitMOD(CodeBlock* codeBlock);
+int emitSHL(CodeBlock* codeBlock, WORD q);
+int emitSHR(CodeBlock* codeBlock, WORD q);
+int emitAND(CodeBlock* codeBlock, WORD q);
+
+int emitLOOP(CodeBlock* codeBlock, WORD p, WORD q);
+
+int operandsOf(enum OpCode op);
+
+// Instructions from address on come from line:column; later entries are dropped
+int addLine(CodeBlock* codeBlock, CodeAddress address, int line, int column);
+// Returns 0 when the position of the instruction at address is unknown
+int findLine(CodeBlock* codeBlock, CodeAddress address, int* line, int* column);
+
+const char* opCodeName(enum OpCode op);
+void fprintInstruction(FILE* f, Instruction* instruction);
 void printInstruction(Instruction* instruction);
 void printCodeBlock(CodeBlock* codeBlock);
 
-void loadCode(CodeBlock* codeBlock, FILE* f);
+int loadCode(CodeBlock* codeBlock, FILE* f);
 void saveCode(CodeBlock* codeBlock, FILE* f);
 
+CodeBlock* mapCode(char* fileName);
+
 #endif
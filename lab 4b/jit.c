@@ -0,0 +1,494 @@
+/*
+ * @copyright (c) 2008, Hedspi, Hanoi University of Technology
+ * @author Huu-Duc Nguyen
+ * @version 1.0
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "jit.h"
+
+#if defined(__x86_64__) && !defined(_WIN32)
+
+#include <sys/mman.h>
+
+// Longest template (R_MOD) plus room for one exit stub per instruction
+#define MAX_TEMPLATE_SIZE 48
+#define EXIT_STUB_SIZE 10
+#define PROLOGUE_SIZE 8
+
+typedef CodeAddress (*NativeCode)(WORD* frame, void* entry);
+
+typedef struct {
+  unsigned char* at;       // rel32 field to patch
+  CodeAddress target;
+} Fixup;
+
+// Per thread: VMs running in parallel compile their procedures independently
+static __thread unsigned char* out;
+static __thread Fixup* fixups;
+static __thread int fixupCount;
+static __thread Fixup* exits;
+static __thread int exitCount;
+
+/******************* Walking procedures ******************************/
+
+static int isRegJump(enum RegOpCode op) {
+  return (op == R_J) || ((op >= R_FJ) && (op <= R_LOOPK));
+}
+
+static int fallsThrough(enum RegOpCode op) {
+  return (op != R_J) && (op != R_RET) && (op != R_HL);
+}
+
+// Collect the instructions reachable from start without entering callees
+static int walk(RegCode* regCode, CodeAddress start, char* seen, CodeAddress* reached) {
+  RegInstruction* inst;
+  int count = 0, done = 0;
+  CodeAddress i;
+
+  seen[start] = 1;
+  reached[count++] = start;
+  while (done < count) {
+    i = reached[done++];
+    inst = regCode->code + i;
+    if (fallsThrough(inst->op) && (i + 1 < regCode->codeSize) && !seen[i + 1]) {
+      seen[i + 1] = 1;
+      reached[count++] = i + 1;
+    }
+    if (isRegJump(inst->op) && !seen[inst->c]) {
+      seen[inst->c] = 1;
+      reached[count++] = inst->c;
+    }
+  }
+  return count;
+}
+
+/******************* Code emission ******************************/
+
+static void put8(int b) {
+  *out++ = (unsigned char) b;
+}
+
+static void put32(int v) {
+  put8(v);
+  put8(v >> 8);
+  put8(v >> 16);
+  put8(v >> 24);
+}
+
+static int displacement(WORD slot) {
+  return slot * (int) sizeof(WORD);
+}
+
+// <op> eax, [rbx + slot]  or  [rbx + slot], eax
+static void slotOp(int opcode, WORD slot) {
+  put8(opcode);
+  put8(0x83);
+  put32(displacement(slot));
+}
+
+static void load(WORD slot) {
+  slotOp(0x8b, slot);              // mov eax, [rbx + d]
+}
+
+static void store(WORD slot) {
+  slotOp(0x89, slot);              // mov [rbx + d], eax
+}
+
+static void jumpTo(int opcode, CodeAddress target) {
+  if (opcode == 0xe9) put8(0xe9);  // jmp rel32
+  else {
+    put8(0x0f);                    // jcc rel32
+    put8(opcode);
+  }
+  fixups[fixupCount].at = out;
+  fixups[fixupCount ++].target = target;
+  put32(0);
+}
+
+// Leave native code, handing pc back to the interpreter
+static void exitTo(CodeAddress pc, unsigned char* epilogue) {
+  put8(0xb8);                      // mov eax, pc
+  put32(pc);
+  put8(0xe9);                      // jmp epilogue
+  put32((int) (epilogue - (out + 4)));
+}
+
+static void exitIf(int condition, CodeAddress pc) {
+  put8(0x0f);
+  put8(condition);
+  exits[exitCount].at = out;
+  exits[exitCount ++].target = pc;
+  put32(0);
+}
+
+// Condition codes of EQ, NE, GT, LT, GE, LE; x ^ 1 is the opposite test
+static int conditionCode[] = { 0x4, 0x5, 0xf, 0xc, 0xd, 0xe };
+
+// Returns 0 if the instruction has no template
+static int emitTemplate(RegInstruction* inst, CodeAddress pc) {
+  switch (inst->op) {
+  case R_MOVE:
+    load(inst->b);
+    store(inst->a);
+    break;
+  case R_LOADK:
+    put8(0xc7);                    // mov dword [rbx + d], imm32
+    put8(0x83);
+    put32(displacement(inst->a));
+    put32(inst->b);
+    break;
+  case R_ADD:
+  case R_SUB:
+  case R_MUL:
+    load(inst->b);
+    if (inst->op == R_ADD) slotOp(0x03, inst->c);
+    else if (inst->op == R_SUB) slotOp(0x2b, inst->c);
+    else {
+      put8(0x0f);                  // imul eax, [rbx + d]
+      put8(0xaf);
+      put8(0x83);
+      put32(displacement(inst->c));
+    }
+    store(inst->a);
+    break;
+  case R_DIV:
+  case R_MOD:
+    load(inst->b);
+    put8(0x8b);                    // mov ecx, [rbx + d]
+    put8(0x8b);
+    put32(displacement(inst->c));
+    put8(0x85);                    // test ecx, ecx
+    put8(0xc9);
+    exitIf(0x84, pc);              // the interpreter reports the error
+    put8(0x83);                    // cmp ecx, -1
+    put8(0xf9);
+    put8(0xff);
+    exitIf(0x84, pc);
+    put8(0x99);                    // cdq
+    put8(0xf7);                    // idiv ecx
+    put8(0xf9);
+    if (inst->op == R_MOD) {
+      put8(0x89);                  // mov eax, edx
+      put8(0xd0);
+    }
+    store(inst->a);
+    break;
+  case R_ADDK:
+  case R_SUBK:
+  case R_MULK:
+    load(inst->b);
+    if (inst->op == R_ADDK) put8(0x05);        // add eax, imm32
+    else if (inst->op == R_SUBK) put8(0x2d);   // sub eax, imm32
+    else {
+      put8(0x69);                  // imul eax, eax, imm32
+      put8(0xc0);
+    }
+    put32(inst->c);
+    store(inst->a);
+    break;
+  case R_DIVK:
+  case R_MODK:
+    load(inst->b);
+    put8(0xb9);                    // mov ecx, imm32
+    put32(inst->c);
+    put8(0x99);
+    put8(0xf7);
+    put8(0xf9);
+    if (inst->op == R_MODK) {
+      put8(0x89);                  // mov eax, edx
+      put8(0xd0);
+    }
+    store(inst->a);
+    break;
+  case R_SHL:
+    load(inst->b);
+    put8(0xc1);                    // shl eax, imm8
+    put8(0xe0);
+    put8(inst->c);
+    store(inst->a);
+    break;
+  case R_SHR:
+    // Round toward 0: add 2^c - 1 to a negative dividend first
+    load(inst->b);
+    put8(0x89);                    // mov edx, eax
+    put8(0xc2);
+    put8(0xc1);                    // sar edx, 31
+    put8(0xfa);
+    put8(31);
+    put8(0x81);                    // and edx, imm32
+    put8(0xe2);
+    put32((1 << inst->c) - 1);
+    put8(0x01);                    // add eax, edx
+    put8(0xd0);
+    put8(0xc1);                    // sar eax, imm8
+    put8(0xf8);
+    put8(inst->c);
+    store(inst->a);
+    break;
+  case R_AND:
+    load(inst->b);
+    put8(0x25);                    // and eax, imm32
+    put32(inst->c);
+    store(inst->a);
+    break;
+  case R_NEG:
+    load(inst->b);
+    put8(0xf7);                    // neg eax
+    put8(0xd8);
+    store(inst->a);
+    break;
+  case R_EQ:
+  case R_NE:
+  case R_GT:
+  case R_LT:
+  case R_GE:
+  case R_LE:
+    load(inst->b);
+    slotOp(0x3b, inst->c);         // cmp eax, [rbx + d]
+    put8(0x0f);                    // setcc al
+    put8(0x90 + conditionCode[inst->op - R_EQ]);
+    put8(0xc0);
+    put8(0x0f);                    // movzx eax, al
+    put8(0xb6);
+    put8(0xc0);
+    store(inst->a);
+    break;
+  case R_INC:
+    put8(0x81);                    // add dword [rbx + d], imm32
+    put8(0x83);
+    put32(displacement(inst->a));
+    put32(inst->b);
+    break;
+  case R_J:
+    jumpTo(0xe9, inst->c);
+    break;
+  case R_FJ:
+    load(inst->a);
+    put8(0x85);                    // test eax, eax
+    put8(0xc0);
+    jumpTo(0x84, inst->c);
+    break;
+  case R_FEQ:
+  case R_FNE:
+  case R_FGT:
+  case R_FLT:
+  case R_FGE:
+  case R_FLE:
+    load(inst->a);
+    slotOp(0x3b, inst->b);
+    jumpTo(0x80 + (conditionCode[inst->op - R_FEQ] ^ 1), inst->c);
+    break;
+  case R_FEQK:
+  case R_FNEK:
+  case R_FGTK:
+  case R_FLTK:
+  case R_FGEK:
+  case R_FLEK:
+    load(inst->a);
+    put8(0x3d);                    // cmp eax, imm32
+    put32(inst->b);
+    jumpTo(0x80 + (conditionCode[inst->op - R_FEQK] ^ 1), inst->c);
+    break;
+  case R_LOOP:
+  case R_LOOPK:
+    put8(0x83);                    // add dword [rbx + d], 1
+    put8(0x83);
+    put32(displacement(inst->a));
+    put8(1);
+    load(inst->a);
+    if (inst->op == R_LOOP) slotOp(0x3b, inst->b);
+    else {
+      put8(0x3d);                  // cmp eax, imm32
+      put32(inst->b);
+    }
+    jumpTo(0x80 + conditionCode[R_LE - R_EQ], inst->c);
+    break;
+  default:
+    return 0;
+  }
+  return 1;
+}
+
+static void patch(unsigned char* at, unsigned char* target) {
+  int rel = (int) (target - (at + 4));
+
+  at[0] = rel;
+  at[1] = rel >> 8;
+  at[2] = rel >> 16;
+  at[3] = rel >> 24;
+}
+
+static void compileProcedure(Jit* jit, CodeAddress start) {
+  RegCode* regCode = jit->regCode;
+  char* seen = (char*) calloc(regCode->codeSize, sizeof(char));
+  CodeAddress* reached = (CodeAddress*) malloc(regCode->codeSize * sizeof(CodeAddress));
+  unsigned char** label;
+  unsigned char* buffer;
+  unsigned char* epilogue;
+  long size;
+  int count, i, k;
+
+  count = walk(regCode, start, seen, reached);
+  size = PROLOGUE_SIZE + (long) count * (MAX_TEMPLATE_SIZE + 2 * EXIT_STUB_SIZE);
+  buffer = (unsigned char*) mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (buffer == MAP_FAILED) {
+    jit->failed = 1;
+    free(seen);
+    free(reached);
+    return;
+  }
+
+  label = (unsigned char**) calloc(regCode->codeSize, sizeof(unsigned char*));
+  fixups = (Fixup*) malloc(count * sizeof(Fixup));
+  exits = (Fixup*) malloc(2 * count * sizeof(Fixup));
+  fixupCount = 0;
+  exitCount = 0;
+
+  out = buffer;
+  put8(0x53);                      // push rbx
+  put8(0x48);                      // mov rbx, rdi
+  put8(0x89);
+  put8(0xfb);
+  put8(0xff);                      // jmp rsi
+  put8(0xe6);
+  epilogue = out;
+  put8(0x5b);                      // pop rbx
+  put8(0xc3);                      // ret
+
+  // Lay the instructions out in address order so that fall-through still
+  // works; seen[i] becomes 2 for those that got a template
+  for (i = 0; i < regCode->codeSize; i ++) {
+    if (!seen[i]) continue;
+    label[i] = out;
+    if (emitTemplate(regCode->code + i, i))
+      seen[i] = 2;
+    else
+      exitTo(i, epilogue);
+  }
+
+  for (k = 0; k < exitCount; k ++) {
+    patch(exits[k].at, out);
+    exitTo(exits[k].target, epilogue);
+  }
+  for (k = 0; k < fixupCount; k ++)
+    patch(fixups[k].at, label[fixups[k].target]);
+
+  if (mprotect(buffer, size, PROT_READ | PROT_EXEC) != 0) {
+    munmap(buffer, size);
+    jit->failed = 1;
+  } else {
+    jit->blockSize[start] = size;
+    if (jit->trampoline == NULL) jit->trampoline = buffer;
+    __atomic_store_n(&jit->block[start], buffer, __ATOMIC_RELEASE);
+    // Instructions shared with a procedure compiled earlier keep their entry.
+    // Other threads may take an entry as soon as it is stored
+    for (i = 0; i < regCode->codeSize; i ++)
+      if ((seen[i] == 2) && (jit->native[i] == NULL))
+	__atomic_store_n(&jit->native[i], label[i], __ATOMIC_RELEASE);
+  }
+
+  free(label);
+  free(fixups);
+  free(exits);
+  free(seen);
+  free(reached);
+}
+
+/******************************************************************/
+
+Jit* createJit(RegCode* regCode) {
+  Jit* jit = (Jit*) malloc(sizeof(Jit));
+  int n = regCode->codeSize;
+  char* seen = (char*) calloc(n, sizeof(char));
+  CodeAddress* reached = (CodeAddress*) malloc(n * sizeof(CodeAddress));
+  int count, i, k;
+
+  jit->regCode = regCode;
+  jit->native = (void**) calloc(n, sizeof(void*));
+  jit->procedure = (CodeAddress*) malloc(n * sizeof(CodeAddress));
+  jit->counter = (int*) calloc(n, sizeof(int));
+  jit->block = (void**) calloc(n, sizeof(void*));
+  jit->blockSize = (long*) calloc(n, sizeof(long));
+  jit->trampoline = NULL;
+  jit->failed = 0;
+  pthread_mutex_init(&jit->lock, NULL);
+
+  // Every procedure starts with the R_CHECK of its frame
+  for (i = 0; i < n; i ++)
+    jit->procedure[i] = -1;
+  for (i = 0; i < n; i ++) {
+    if (regCode->code[i].op != R_CHECK) continue;
+    count = walk(regCode, i, seen, reached);
+    for (k = 0; k < count; k ++)
+      if (jit->procedure[reached[k]] < 0)
+	jit->procedure[reached[k]] = i;
+  }
+
+  free(seen);
+  free(reached);
+  return jit;
+}
+
+void freeJit(Jit* jit) {
+  int i;
+
+  for (i = 0; i < jit->regCode->codeSize; i ++)
+    if (jit->block[i] != NULL)
+      munmap(jit->block[i], jit->blockSize[i]);
+  free(jit->native);
+  free(jit->procedure);
+  free(jit->counter);
+  free(jit->block);
+  free(jit->blockSize);
+  pthread_mutex_destroy(&jit->lock);
+  free(jit);
+}
+
+int jitReady(Jit* jit, CodeAddress pc) {
+  return __atomic_load_n(&jit->native[pc], __ATOMIC_ACQUIRE) != NULL;
+}
+
+int jitHot(Jit* jit, CodeAddress pc) {
+  CodeAddress start;
+
+  if (jitReady(jit, pc)) return 1;
+  start = jit->procedure[pc];
+  if ((start < 0) || (__atomic_load_n(&jit->block[start], __ATOMIC_ACQUIRE) != NULL)) return 0;
+
+  // Only the thread that counts the last entry compiles the procedure
+  pthread_mutex_lock(&jit->lock);
+  if (!jit->failed && (jit->block[start] == NULL) && (++ jit->counter[start] >= JIT_THRESHOLD))
+    compileProcedure(jit, start);
+  pthread_mutex_unlock(&jit->lock);
+  return jitReady(jit, pc);
+}
+
+// Every block starts with the same prologue, so any of them can enter any other
+CodeAddress jitRun(Jit* jit, WORD* frame, CodeAddress pc) {
+  return ((NativeCode) jit->trampoline)(frame, jit->native[pc]);
+}
+
+#else
+
+Jit* createJit(RegCode* regCode) {
+  return NULL;
+}
+
+void freeJit(Jit* jit) {
+}
+
+int jitHot(Jit* jit, CodeAddress pc) {
+  return 0;
+}
+
+int jitReady(Jit* jit, CodeAddress pc) {
+  return 0;
+}
+
+CodeAddress jitRun(Jit* jit, WORD* frame, CodeAddress pc) {
+  return pc;
+}
+
+#endif
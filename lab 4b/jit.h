@@ -0,0 +1,62 @@
+/*
+ * @copyright (c) 2008, Hedspi, Hanoi University of Technology
+ * @author Huu-Duc Nguyen
+ * @version 1.0
+ */
+
+#ifndef __JIT_H__
+#define __JIT_H__
+
+#ifndef _WIN32
+#include <pthread.h>
+#endif
+#include "regcode.h"
+
+// Calls plus backward jumps before a procedure is compiled
+#define JIT_THRESHOLD 1000
+
+/*
+ * Template compiler from the register form to x86-64. A procedure is
+ * compiled as a whole once it is hot; every instruction the templates
+ * cover gets a native entry, the others compile to an exit that hands
+ * the instruction back to the interpreter. Native code keeps all state
+ * in the stack frame, so control can move between the two at any
+ * instruction boundary.
+ *
+ * A Jit belongs to a loaded program and lives as long as it does, so
+ * procedures compiled during one run are reused by the next; batch
+ * workers running the same program share it. It is off unless asked
+ * for: indirect loads and stores, addresses, non-local values, calls
+ * and frame checks have no templates yet, so loops over arrays would
+ * leave native code at every element.
+ */
+
+struct Jit_ {
+  RegCode* regCode;
+  void** native;           // native entry of each register instruction, or NULL
+  CodeAddress* procedure;  // start of the procedure each instruction belongs to
+  int* counter;            // per procedure start
+  void** block;            // per procedure start: its compiled code
+  long* blockSize;
+  void* trampoline;        // entry sequence shared by all blocks
+  int failed;
+#ifndef _WIN32
+  pthread_mutex_t lock;    // counting and compiling, for VMs sharing the program
+#endif
+};
+
+typedef struct Jit_ Jit;
+
+// NULL when the JIT is not available on this platform
+Jit* createJit(RegCode* regCode);
+void freeJit(Jit* jit);
+
+// Count an entry at pc; returns 1 if native code for pc is ready
+int jitHot(Jit* jit, CodeAddress pc);
+// Returns 1 if native code for pc is ready, without counting
+int jitReady(Jit* jit, CodeAddress pc);
+
+// Run native code from pc; returns the address where the interpreter resumes
+CodeAddress jitRun(Jit* jit, WORD* frame, CodeAddress pc);
+
+#endif
@@ -0,0 +1,178 @@
+/*
+ * @copyright (c) 2008, Hedspi, Hanoi University of Technology
+ * @author Huu-Duc Nguyen
+ * @version 1.0
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "reader.h"
+#include "instructions.h"
+#include "kplb.h"
+#include "emitc.h"
+
+#define MAX_ASM_LINE 256
+
+/*
+ * Assembles a listing in the format printed by -dump, one instruction
+ * per line:
+ *
+ *   12:  LV 0,5
+ *
+ * The address before the colon is optional; when given it must be the
+ * address the instruction gets. Operands are written as -dump writes
+ * them. Anything after ';' is a comment. An opcode may also be given as
+ * a number, with an optional p,q: the verifier tests use this to write
+ * opcodes that do not exist, which only a raw image can hold.
+ */
+
+int rawImage = 0;
+int cSource = 0;
+
+void printUsage(void) {
+  printf("Usage: kplasm input output [-raw] [-c]\n");
+  printf("   input: listing in the format printed by -dump\n");
+  printf("   output: executable\n");
+  printf("   -raw: write a raw instruction dump instead of a .kplb executable\n");
+  printf("   -c: write the program as C source, as kplc -emit-c does\n");
+}
+
+int analyseParam(char* param) {
+  if (strcmp(param, "-raw") == 0) {
+    rawImage = 1;
+    return 1;
+  }
+  if (strcmp(param, "-c") == 0) {
+    cSource = 1;
+    return 1;
+  }
+  return 0;
+}
+
+// The opcode named by word, or -1
+int findOpCode(char* word) {
+  int op;
+
+  if (isdigit((unsigned char) word[0])) return atoi(word);
+  for (op = 0; op <= MAX_OPCODE; op ++)
+    if (strcmp(word, opCodeName(op)) == 0) return op;
+  return -1;
+}
+
+// Returns 0 when the line is not an instruction of the listing
+int assembleLine(CodeBlock* codeBlock, char* text) {
+  char word[MAX_ASM_LINE];
+  char* comment = strchr(text, ';');
+  int address, op, operands, n;
+  WORD p = DC_VALUE, q = DC_VALUE;
+
+  if (comment != NULL) *comment = '\0';
+
+  // An opcode given as a number has no colon after it
+  n = -1;
+  if ((sscanf(text, " %d :%n", &address, &n) == 1) && (n >= 0)) {
+    if (address != codeBlock->codeSize) return 0;
+    text += n;
+  }
+  if (sscanf(text, " %s%n", word, &n) != 1) return 1;
+  text += n;
+
+  op = findOpCode(word);
+  if (op < 0) return 0;
+
+  operands = ((unsigned) op > MAX_OPCODE) ? OPERAND_P | OPERAND_Q : operandsOf(op);
+  if (operands & OPERAND_P) {
+    n = sscanf(text, " %d , %d %s", &p, &q, word);
+    if ((n != 2) && !(((unsigned) op > MAX_OPCODE) && (n == EOF))) return 0;
+  } else if (operands & OPERAND_Q) {
+    if (sscanf(text, " %d %s", &q, word) != 1) return 0;
+  } else if (sscanf(text, " %s", word) == 1) return 0;
+
+  return emitCode(codeBlock, op, p, q);
+}
+
+int assemble(CodeBlock* codeBlock, char* fileName) {
+  char text[MAX_ASM_LINE];
+  FILE* f;
+  int line = 0;
+
+  f = fopen(fileName, "r");
+  if (f == NULL) {
+    printf("Can\'t read input file!\n");
+    return 0;
+  }
+
+  while (fgets(text, MAX_ASM_LINE, f) != NULL) {
+    line ++;
+    if (!assembleLine(codeBlock, text)) {
+      printf("%s:%d: bad instruction\n", fileName, line);
+      fclose(f);
+      return 0;
+    }
+  }
+
+  fclose(f);
+  return 1;
+}
+
+int writeImage(CodeBlock* codeBlock, char* fileName, CodeAddress* errorAddress) {
+  FILE* f;
+  int status;
+
+  f = fopen(fileName, cSource ? "w" : "wb");
+  if (f == NULL) return IO_ERROR;
+  if (rawImage) saveCode(codeBlock, f);
+  else {
+    status = cSource ? writeC(codeBlock, f, errorAddress) : writeExecutable(codeBlock, f);
+    if (status != IO_SUCCESS) {
+      fclose(f);
+      return status;
+    }
+  }
+  if (fclose(f) != 0) return IO_ERROR;
+  return IO_SUCCESS;
+}
+
+/******************************************************************/
+
+int main(int argc, char *argv[]) {
+  CodeBlock* codeBlock;
+  CodeAddress errorAddress;
+  int status;
+  int i;
+
+  if (argc <= 1) {
+    printf("kplasm: no input file.\n");
+    printUsage();
+    return -1;
+  }
+
+  if (argc <= 2) {
+    printf("kplasm: no output file.\n");
+    printUsage();
+    return -1;
+  }
+
+  for (i = 3; i < argc; i ++)
+    analyseParam(argv[i]);
+
+  codeBlock = createCodeBlock(0);
+  if (!assemble(codeBlock, argv[1])) {
+    freeCodeBlock(codeBlock);
+    return -1;
+  }
+
+  status = writeImage(codeBlock, argv[2], &errorAddress);
+  if (status != IO_SUCCESS) {
+    if (status == IO_ERROR) printf("Can\'t write output file!\n");
+    else fprintf(stderr, "%d: %s\n", errorAddress, invalidCodeToString(status));
+    freeCodeBlock(codeBlock);
+    return -1;
+  }
+
+  freeCodeBlock(codeBlock);
+  return 0;
+}
@@ -0,0 +1,287 @@
+/*
+ * @copyright (c) 2008, Hedspi, Hanoi University of Technology
+ * @author Huu-Duc Nguyen
+ * @version 1.0
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "reader.h"
+#include "kplb.h"
+
+#define MAX_VARINT_LEN 5
+
+/******************* Byte utilities ******************************/
+
+static void put16(unsigned char* p, unsigned int v) {
+  p[0] = v & 0xff;
+  p[1] = (v >> 8) & 0xff;
+}
+
+static void put32(unsigned char* p, unsigned int v) {
+  p[0] = v & 0xff;
+  p[1] = (v >> 8) & 0xff;
+  p[2] = (v >> 16) & 0xff;
+  p[3] = (v >> 24) & 0xff;
+}
+
+static unsigned int get16(unsigned char* p) {
+  return p[0] | (p[1] << 8);
+}
+
+static unsigned int get32(unsigned char* p) {
+  return p[0] | (p[1] << 8) | (p[2] << 16) | ((unsigned int) p[3] << 24);
+}
+
+// Zigzag maps small negative numbers to small codes: 0,-1,1,-2 -> 0,1,2,3
+static int putVarint(unsigned char* p, WORD w) {
+  unsigned int v = ((unsigned int) w << 1) ^ (unsigned int) (w >> 31);
+  int n = 0;
+
+  while (v >= 0x80) {
+    p[n++] = (v & 0x7f) | 0x80;
+    v >>= 7;
+  }
+  p[n++] = v;
+  return n;
+}
+
+// Returns the number of bytes read, or 0 if the varint runs past end
+static int getVarint(unsigned char* p, unsigned char* end, WORD* w) {
+  unsigned int v = 0;
+  int shift = 0;
+  int n = 0;
+
+  while ((p + n < end) && (n < MAX_VARINT_LEN)) {
+    v |= (unsigned int) (p[n] & 0x7f) << shift;
+    if ((p[n++] & 0x80) == 0) {
+      *w = (WORD) ((v >> 1) ^ (0u - (v & 1)));
+      return n;
+    }
+    shift += 7;
+  }
+  return 0;
+}
+
+unsigned int crc32(unsigned int crc, unsigned char* data, long size) {
+  static unsigned int table[256];
+  static int tableReady = 0;
+  unsigned int c;
+  int i, k;
+
+  if (!tableReady) {
+    for (i = 0; i < 256; i ++) {
+      c = i;
+      for (k = 0; k < 8; k ++)
+	c = (c & 1) ? (0xedb88320 ^ (c >> 1)) : (c >> 1);
+      table[i] = c;
+    }
+    tableReady = 1;
+  }
+
+  crc = ~crc;
+  while (size-- > 0)
+    crc = table[(crc ^ *data++) & 0xff] ^ (crc >> 8);
+  return ~crc;
+}
+
+/******************* Writing ******************************/
+
+static long encodeCode(CodeBlock* codeBlock, unsigned char* p) {
+  Instruction* inst = codeBlock->code;
+  unsigned char* start = p;
+  int operands;
+  int i;
+
+  for (i = 0; i < codeBlock->codeSize; i ++, inst ++) {
+    operands = operandsOf(inst->op);
+    *p++ = inst->op;
+    if (operands & OPERAND_P) p += putVarint(p, inst->p);
+    if (operands & OPERAND_Q) p += putVarint(p, inst->q);
+  }
+  return p - start;
+}
+
+// Only the entries for code that is still there
+static int countLines(CodeBlock* codeBlock) {
+  int n = codeBlock->lineCount;
+
+  while ((n > 0) && (codeBlock->lines[n - 1].address >= codeBlock->codeSize))
+    n --;
+  return n;
+}
+
+static long encodeLines(CodeBlock* codeBlock, int count, unsigned char* p) {
+  LineEntry* entry = codeBlock->lines;
+  unsigned char* start = p;
+  CodeAddress address = 0;
+  int line = 0;
+  int i;
+
+  for (i = 0; i < count; i ++, entry ++) {
+    p += putVarint(p, entry->address - address);
+    p += putVarint(p, entry->line - line);
+    p += putVarint(p, entry->column);
+    address = entry->address;
+    line = entry->line;
+  }
+  return p - start;
+}
+
+int writeExecutable(CodeBlock* codeBlock, FILE* f) {
+  unsigned char* image;
+  unsigned char* section;
+  int lineCount = countLines(codeBlock);
+  int sectionCount = (lineCount > 0) ? 2 : 1;
+  long codeOffset = KPLB_HEADER_SIZE + sectionCount * KPLB_SECTION_ENTRY_SIZE;
+  long codeLength, linesLength;
+  long size;
+  int ok;
+
+  image = (unsigned char*) malloc(codeOffset + (long) codeBlock->codeSize * (1 + 2 * MAX_VARINT_LEN) +
+				  (long) lineCount * 3 * MAX_VARINT_LEN);
+  codeLength = encodeCode(codeBlock, image + codeOffset);
+  linesLength = encodeLines(codeBlock, lineCount, image + codeOffset + codeLength);
+  size = codeOffset + codeLength + linesLength;
+
+  memcpy(image, KPLB_MAGIC, 4);
+  put16(image + 4, KPLB_VERSION);
+  put16(image + 6, sectionCount);
+  put32(image + 8, codeBlock->entry);
+  put32(image + 12, codeBlock->frameSize);
+  put32(image + 16, codeBlock->codeSize);
+  put32(image + 20, 0);
+
+  section = image + KPLB_HEADER_SIZE;
+  put32(section, SECTION_CODE);
+  put32(section + 4, codeOffset);
+  put32(section + 8, codeLength);
+
+  if (lineCount > 0) {
+    section += KPLB_SECTION_ENTRY_SIZE;
+    put32(section, SECTION_LINES);
+    put32(section + 4, codeOffset + codeLength);
+    put32(section + 8, linesLength);
+  }
+
+  put32(image + 20, crc32(0, image, size));
+
+  ok = (fwrite(image, 1, size, f) == (size_t) size);
+  free(image);
+  return ok ? IO_SUCCESS : IO_ERROR;
+}
+
+/******************* Reading ******************************/
+
+int isExecutable(unsigned char* data, long size) {
+  return (size >= KPLB_HEADER_SIZE) && (memcmp(data, KPLB_MAGIC, 4) == 0);
+}
+
+static int decodeCode(CodeBlock* codeBlock, unsigned char* p, unsigned char* end) {
+  Instruction* inst = codeBlock->code;
+  int operands;
+  int i, n;
+
+  for (i = 0; i < codeBlock->maxSize; i ++, inst ++) {
+    if (p >= end) return 0;
+    inst->op = *p++;
+    inst->p = DC_VALUE;
+    inst->q = DC_VALUE;
+    if (inst->op > MAX_OPCODE) return 0;
+
+    operands = operandsOf(inst->op);
+    if (operands & OPERAND_P) {
+      if ((n = getVarint(p, end, &inst->p)) == 0) return 0;
+      p += n;
+    }
+    if (operands & OPERAND_Q) {
+      if ((n = getVarint(p, end, &inst->q)) == 0) return 0;
+      p += n;
+    }
+  }
+  codeBlock->codeSize = codeBlock->maxSize;
+  return p == end;
+}
+
+// Entries must name increasing addresses inside the code
+static int decodeLines(CodeBlock* codeBlock, unsigned char* p, unsigned char* end) {
+  WORD address = -1, line = 0;
+  WORD delta, column;
+  int n;
+
+  while (p < end) {
+    if ((n = getVarint(p, end, &delta)) == 0) return 0;
+    p += n;
+    if ((delta <= 0) && (address >= 0)) return 0;
+    address = (address < 0) ? delta : address + delta;
+    if ((address < 0) || (address >= codeBlock->codeSize)) return 0;
+
+    if ((n = getVarint(p, end, &delta)) == 0) return 0;
+    p += n;
+    line += delta;
+    if ((n = getVarint(p, end, &column)) == 0) return 0;
+    p += n;
+
+    if (!addLine(codeBlock, address, line, column)) return 0;
+  }
+  return 1;
+}
+
+// Decode an image held in memory; NULL if it is malformed or corrupted
+CodeBlock* readExecutable(unsigned char* data, long size) {
+  CodeBlock* codeBlock = NULL;
+  unsigned char* section;
+  unsigned int crc, offset, length;
+  unsigned int codeSize;
+  unsigned char* lines = NULL;
+  unsigned int linesLength = 0;
+  int sectionCount;
+  int i;
+
+  if (!isExecutable(data, size)) return NULL;
+  if (get16(data + 4) != KPLB_VERSION) return NULL;
+
+  // The stored checksum was computed with its own field zeroed
+  crc = crc32(0, data, 20);
+  crc = crc32(crc, (unsigned char*) "\0\0\0\0", 4);
+  crc = crc32(crc, data + KPLB_HEADER_SIZE, size - KPLB_HEADER_SIZE);
+  if (crc != get32(data + 20)) return NULL;
+
+  sectionCount = get16(data + 6);
+  if (KPLB_HEADER_SIZE + (long) sectionCount * KPLB_SECTION_ENTRY_SIZE > size) return NULL;
+
+  codeSize = get32(data + 16);
+  if (codeSize > (unsigned int) size) return NULL;
+
+  for (i = 0; i < sectionCount; i ++) {
+    section = data + KPLB_HEADER_SIZE + i * KPLB_SECTION_ENTRY_SIZE;
+    offset = get32(section + 4);
+    length = get32(section + 8);
+    if ((offset > (unsigned long) size) || (length > (unsigned long) size - offset)) break;
+
+    if ((get32(section) == SECTION_CODE) && (codeBlock == NULL)) {
+      codeBlock = createCodeBlock(codeSize);
+      if (!decodeCode(codeBlock, data + offset, data + offset + length)) break;
+    }
+    if ((get32(section) == SECTION_LINES) && (lines == NULL)) {
+      lines = data + offset;
+      linesLength = length;
+    }
+  }
+
+  // The line table refers to the code, wherever the two sections are
+  if ((codeBlock != NULL) && (i == sectionCount) && (lines != NULL) &&
+      !decodeLines(codeBlock, lines, lines + linesLength))
+    i = -1;
+
+  if ((codeBlock != NULL) && ((i != sectionCount) || (codeBlock->codeSize != (int) codeSize))) {
+    freeCodeBlock(codeBlock);
+    return NULL;
+  }
+  if (codeBlock == NULL) return NULL;
+
+  codeBlock->entry = get32(data + 8);
+  codeBlock->frameSize = get32(data + 12);
+  return codeBlock;
+}
@@ -0,0 +1,48 @@
+/*
+ * @copyright (c) 2008, Hedspi, Hanoi University of Technology
+ * @author Huu-Duc Nguyen
+ * @version 1.0
+ */
+
+#ifndef __KPLB_H__
+#define __KPLB_H__
+
+#include <stdio.h>
+#include "instructions.h"
+
+/*
+ * Layout of a .kplb executable (all integers little endian):
+ *
+ *   header         magic "KPLB", u16 version, u16 section count,
+ *                  u32 entry point, u32 frame size, u32 code size,
+ *                  u32 crc32 of the whole file (computed with this field 0)
+ *   section table  section count x (u32 type, u32 offset, u32 length)
+ *   sections       at the offsets given in the table
+ *
+ * The code section holds one opcode byte per instruction followed by the
+ * operands that opcode actually uses, each as a zigzag LEB128 varint.
+ *
+ * The optional line section maps code back to the source. It holds one
+ * entry for each address where the source position changes, as three
+ * zigzag varints: the address, the line and the column, the first two
+ * as differences from the previous entry.
+ *
+ * Readers skip sections whose type they do not know.
+ */
+
+#define KPLB_MAGIC "KPLB"
+#define KPLB_VERSION 1
+
+#define KPLB_HEADER_SIZE 24
+#define KPLB_SECTION_ENTRY_SIZE 12
+
+#define SECTION_CODE 1
+#define SECTION_LINES 2
+
+int isExecutable(unsigned char* data, long size);
+int writeExecutable(CodeBlock* codeBlock, FILE* f);
+CodeBlock* readExecutable(unsigned char* data, long size);
+
+unsigned int crc32(unsigned int crc, unsigned char* data, long size);
+
+#endif
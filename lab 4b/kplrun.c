@@ -0,0 +1,118 @@
+/*
+ * @copyright (c) 2008, Hedspi, Hanoi University of Technology
+ * @author Huu-Duc Nguyen
+ * @version 1.0
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "reader.h"
+#include "instructions.h"
+#include "vm.h"
+#include "batch.h"
+
+int dumpCode = 0;
+int stackCode = 0;
+int jit = 0;
+int profiling = 0;
+
+void printUsage(void) {
+  printf("Usage: kplrun input [-dump] [-stack] [-jit] [-profile]\n");
+  printf("       kplrun --batch manifest [-stack] [-jit]\n");
+  printf("   input: executable produced by kplc\n");
+  printf("   manifest: one job per line, \"image input output\"; the jobs run in\n");
+  printf("             parallel, reading input from and writing output to the files\n");
+  printf("   -dump: code dump\n");
+  printf("   -stack: run the stack code as is, without register translation\n");
+  printf("   -jit: compile hot procedures of the register form to native code\n");
+  printf("   -profile: count the instructions executed on the stack code, report them\n");
+  printf("             on stderr and write one line per address to input.prof\n");
+}
+
+int analyseParam(char* param) {
+  if (strcmp(param, "-dump") == 0) {
+    dumpCode = 1;
+    return 1;
+  }
+  if (strcmp(param, "-stack") == 0) {
+    stackCode = 1;
+    return 1;
+  }
+  if (strcmp(param, "-jit") == 0) {
+    jit = 1;
+    return 1;
+  }
+  if (strcmp(param, "-profile") == 0) {
+    profiling = 1;
+    return 1;
+  }
+  return 0;
+}
+
+/******************************************************************/
+
+int main(int argc, char *argv[]) {
+  CodeBlock* codeBlock;
+  VM* vm;
+  VMStatus status;
+  char* profileName;
+  int line, column;
+  int i;
+
+  if (argc <= 1) {
+    printf("kplrun: no input file.\n");
+    printUsage();
+    return -1;
+  }
+
+  if (strcmp(argv[1], "--batch") == 0) {
+    if (argc <= 2) {
+      printf("kplrun: no manifest.\n");
+      printUsage();
+      return -1;
+    }
+    for (i = 3; i < argc; i ++)
+      analyseParam(argv[i]);
+    return (runBatch(argv[2], !stackCode, jit) == 0) ? 0 : -1;
+  }
+
+  for (i = 2; i < argc; i ++)
+    analyseParam(argv[i]);
+
+  codeBlock = mapCode(argv[1]);
+  if (codeBlock == NULL) {
+    printf("Can\'t load input file!\n");
+    return -1;
+  }
+
+  if (dumpCode) printCodeBlock(codeBlock);
+  // The VM writes to the descriptor itself, after anything printed so far
+  fflush(stdout);
+
+  vm = createVM(DEFAULT_STACK_SIZE);
+  vm->registerCode = !stackCode;
+  vm->jit = jit;
+  if (profiling) vm->profile = createProfile(codeBlock);
+  status = run(vm, codeBlock);
+  if (status == VM_HALT) ;
+  else if (findLine(codeBlock, vm->pc, &line, &column))
+    fprintf(stderr, "%d: %s (line %d, column %d)\n", vm->pc, vmStatusToString(status), line, column);
+  else
+    fprintf(stderr, "%d: %s\n", vm->pc, vmStatusToString(status));
+
+  if (profiling) {
+    writeProfileReport(vm->profile, stderr);
+    profileName = (char*) malloc(strlen(argv[1]) + 6);
+    sprintf(profileName, "%s.prof", argv[1]);
+    if (writeProfileDump(vm->profile, profileName) == IO_ERROR)
+      fprintf(stderr, "Can\'t write %s!\n", profileName);
+    free(profileName);
+    freeProfile(vm->profile);
+  }
+
+  freeVM(vm);
+  freeCodeBlock(codeBlock);
+  return (status == VM_HALT) ? 0 : -1;
+}
@@ -7,19 +7,35 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
+#ifndef _WIN32
+#include <unistd.h>
+#include <sys/wait.h>
+#else
+#include <process.h>
+#endif
 
 #include "reader.h"
 #include "parser.h"
 #include "codegen.h"
+#include "emitc.h"
 
 
+// Compiler used to build native executables from the output of -emit-c
+#define C_COMPILER "gcc"
+#define C_OPTIMIZE "-O2"
+
 int dumpCode = 0;
+int emitC = 0;
+int noOptimize = 0;
 
 void printUsage(void) {
-  printf("Usage: kplc input output [-dump]\n");
+  printf("Usage: kplc input output [-dump] [-emit-c] [-noopt]\n");
   printf("   input: input kpl program\n");
   printf("   output: executable\n");
   printf("   -dump: code dump\n");
+  printf("   -emit-c: write the program as output.c and compile it into a native output\n");
+  printf("   -noopt: skip the peephole pass over the compiled code\n");
 }
 
 int analyseParam(char* param) {
@@ -27,13 +43,68 @@ int analyseParam(char* param) {
     dumpCode = 1;
     return 1;
   } 
+  if (strcmp(param, "-emit-c") == 0) {
+    emitC = 1;
+    return 1;
+  }
+  if (strcmp(param, "-noopt") == 0) {
+    noOptimize = 1;
+    return 1;
+  }
   return 0;
 }
 
+// Run the C compiler on source without a shell, so file names are passed as they are
+int runCompiler(char* output, char* source) {
+  char* argv[6];
+#ifndef _WIN32
+  pid_t pid;
+  int status;
+#endif
+
+  argv[0] = C_COMPILER;
+  argv[1] = C_OPTIMIZE;
+  argv[2] = "-o";
+  argv[3] = output;
+  argv[4] = source;
+  argv[5] = NULL;
+
+#ifndef _WIN32
+  fflush(stdout);
+  pid = fork();
+  if (pid < 0) return 0;
+  if (pid == 0) {
+    execvp(argv[0], argv);
+    _exit(127);
+  }
+  while (waitpid(pid, &status, 0) < 0)
+    if (errno != EINTR) return 0;
+  return WIFEXITED(status) && (WEXITSTATUS(status) == 0);
+#else
+  return _spawnvp(_P_WAIT, argv[0], (const char* const*) argv) == 0;
+#endif
+}
+
+// Returns the status of serializeC, or -1 if the C compiler fails
+int buildNative(char* output, CodeAddress* errorAddress) {
+  char* source = (char*) malloc(strlen(output) + 3);
+  int result;
+
+  sprintf(source, "%s.c", output);
+  result = serializeC(source, errorAddress);
+  if ((result == IO_SUCCESS) && !runCompiler(output, source))
+    result = -1;
+
+  free(source);
+  return result;
+}
+
 
 /******************************************************************/
 
 int main(int argc, char *argv[]) {
+  CodeAddress errorAddress;
+  int status;
   int i; 
 
   if (argc <= 1) {
@@ -58,7 +129,23 @@ int main(int argc, char *argv[]) {
     return -1;
   }
 
-  if (serialize(argv[2]) == IO_ERROR) {
+  if (!noOptimize) optimizeCodeBuffer();
+
+  if (emitC) {
+    status = buildNative(argv[2], &errorAddress);
+    switch (status) {
+    case IO_ERROR:
+      printf("Can\'t write output file!\n");
+      return -1;
+    case IO_INVALID_CODE:
+    case IO_INVALID_INSTRUCTION:
+      fprintf(stderr, "%d: %s\n", errorAddress, invalidCodeToString(status));
+      return -1;
+    case -1:
+      printf("Can\'t compile the generated C file!\n");
+      return -1;
+    }
+  } else if (serialize(argv[2]) == IO_ERROR) {
     printf("Can\'t write output file!\n");
     return -1;
   }
@@ -13,6 +13,7 @@
 #include "error.h"
 #include "debug.h"
 #include "codegen.h"
+#include "strpool.h"
 
 Token *currentToken;
 Token *lookAhead;
@@ -22,10 +23,8 @@ extern Type* charType;
 extern SymTab* symtab;
 
 void scan(void) {
-  Token* tmp = currentToken;
   currentToken = lookAhead;
   lookAhead = getValidToken();
-  free(tmp);
 }
 
 void eat(TokenType tokenType) {
@@ -52,6 +51,7 @@ void compileProgram(void) {
 
   // Halt the program
   genHL();
+  setProgramEntry(program);
 
   exitBlock();
 }
@@ -119,7 +119,7 @@ void compileVarDecls(void) {
 }
 
 void compileBlock(void) {
-  Instruction* jmp;
+  CodeAddress jmp;
   // Jump to the body of the block
   jmp = genJ(DC_VALUE);
 
@@ -199,7 +199,7 @@ void compileProcDecl(void) {
 }
 
 ConstantValue* compileUnsignedConstant(void) {
-  ConstantValue* constValue;
+  ConstantValue* constValue = NULL;
   Object* obj;
 
   switch (lookAhead->tokenType) {
@@ -250,7 +250,7 @@ ConstantValue* compileConstant(void) {
 }
 
 ConstantValue* compileConstant2(void) {
-  ConstantValue* constValue;
+  ConstantValue* constValue = NULL;
   Object* obj;
 
   switch (lookAhead->tokenType) {
@@ -274,7 +274,7 @@ ConstantValue* compileConstant2(void) {
 }
 
 Type* compileType(void) {
-  Type* type;
+  Type* type = NULL;
   Type* elementType;
   int arraySize;
   Object* obj;
@@ -313,7 +313,7 @@ Type* compileType(void) {
 }
 
 Type* compileBasicType(void) {
-  Type* type;
+  Type* type = NULL;
 
   switch (lookAhead->tokenType) {
   case KW_INTEGER: 
@@ -404,7 +404,7 @@ void compileStatement(void) {
 
 Type* compileLValue(void) {
   Object* var;
-  Type* varType;
+  Type* varType = NULL;
 
   eat(TK_IDENT);
   
@@ -443,15 +443,22 @@ void compileAssignSt(void) {
   // Generate code for the assignment
   Type* varType;
   Type* expType;
+  int level, offset;
+  int local;
 
   varType = compileLValue();
+  // A plain variable is stored with STL, without pushing its address
+  local = takeVariableAddress(&level, &offset);
   
   eat(SB_ASSIGN);
   expType = compileExpression();
   checkTypeEquality(varType, expType);
   
   // Store the value from stack top to the address below it
-  genST();
+  if (local)
+    genSTL(level, offset);
+  else
+    genST();
 }
 
 void compileCallSt(void) {
@@ -481,15 +488,13 @@ void compileGroupSt(void) {
 
 void compileIfSt(void) {
   // Generate code for if-statement
-  Instruction* fjInstruction;
-  Instruction* jInstruction;
+  CodeAddress fjInstruction;
+  CodeAddress jInstruction;
 
   eat(KW_IF);
-  compileCondition();
-  eat(KW_THEN);
-  
   // Jump to else/end if condition is false
-  fjInstruction = genFJ(DC_VALUE);
+  fjInstruction = compileCondition();
+  eat(KW_THEN);
   
   compileStatement();
   
@@ -513,24 +518,24 @@ void compileIfSt(void) {
 
 void compileWhileSt(void) {
   // Generate code for while statement
-  CodeAddress loopAddress;
-  Instruction* fjInstruction;
+  CodeAddress conditionAddress;
+  CodeAddress bodyAddress;
+  CodeAddress fjInstruction;
   
   eat(KW_WHILE);
   
   // Remember the address of the condition
-  loopAddress = getCurrentCodeAddress();
-  
-  compileCondition();
-  eat(KW_DO);
+  conditionAddress = getCurrentCodeAddress();
   
   // Jump out if condition is false
-  fjInstruction = genFJ(DC_VALUE);
+  fjInstruction = compileCondition();
+  eat(KW_DO);
   
+  bodyAddress = getCurrentCodeAddress();
   compileStatement();
   
-  // Jump back to condition
-  genJ(loopAddress);
+  // Test again at the bottom: one branch per iteration, back to the body
+  genLoopTest(conditionAddress, fjInstruction, bodyAddress);
   
   // Update false jump to after loop
   updateFJ(fjInstruction, getCurrentCodeAddress());
@@ -539,12 +544,52 @@ void compileWhileSt(void) {
 void compileForSt(void) {
   Type* varType;
   Type *type;
-  CodeAddress loopAddress;
-  Instruction* fjInstruction;
+  CodeAddress limitAddress;
+  CodeAddress bodyAddress;
+  CodeAddress fjInstruction;
+  int level, offset;
 
   eat(KW_FOR);
 
   varType = compileLValue();  // This pushes address of loop variable
+
+  if (takeVariableAddress(&level, &offset)) {
+    // The loop variable is addressed directly: nothing stays on the stack
+    eat(SB_ASSIGN);
+    type = compileExpression();
+    checkTypeEquality(varType, type);
+    genSTL(level, offset);
+
+    eat(KW_TO);
+
+    genLV(level, offset);
+    limitAddress = getCurrentCodeAddress();
+    type = compileExpression();
+    checkTypeEquality(varType, type);
+    fjInstruction = genFLE(DC_VALUE);
+
+    eat(KW_DO);
+    bodyAddress = getCurrentCodeAddress();
+    compileStatement();
+
+    if ((level == 0) && isLoopInvariant(limitAddress, fjInstruction, offset)) {
+      // The upper bound may be taken before the increment: LOOP does both and the test
+      genCopy(limitAddress, fjInstruction);
+      genLOOP(offset, bodyAddress);
+    } else {
+      // i := i + 1, fused into INC for local variables
+      genLV(level, offset);
+      genLC(1);
+      genAD();
+      genSTL(level, offset);
+
+      genLV(level, offset);
+      genCopy(limitAddress, fjInstruction);
+      genFGT(bodyAddress);
+    }
+    updateFJ(fjInstruction, getCurrentCodeAddress());
+    return;
+  }
   
   // Copy address for later use in the loop
   genCV();
@@ -559,25 +604,23 @@ void compileForSt(void) {
   
   eat(KW_TO);
 
-  // Remember the address for loop condition check
   // At this point, address of i is still on stack (from CV above)
-  loopAddress = getCurrentCodeAddress();
-  
   // Copy address and load value of loop variable
   genCV();
   genLI();
   
+  // Remember the address of the upper bound, to test it again at the bottom
+  limitAddress = getCurrentCodeAddress();
+
   // Push upper bound onto stack
   type = compileExpression();
   checkTypeEquality(varType, type);
   
-  // Generate comparison: check if loop var <= upper bound
-  genLE();
-  
-  // Jump out if condition is false (loop var > upper bound)
-  fjInstruction = genFJ(DC_VALUE);
+  // Jump out when the loop var is above the upper bound
+  fjInstruction = genFLE(DC_VALUE);
 
   eat(KW_DO);
+  bodyAddress = getCurrentCodeAddress();
   compileStatement();
   
   // Increment loop variable:
@@ -593,8 +636,9 @@ void compileForSt(void) {
   genCV();        // Copy address
   genLI();        // Load i value
   
-  // Jump back to comparison with upper bound
-  genJ(loopAddress + 2);  // Skip CV and LI, go directly to upper bound expression
+  // Go back to the body while i is within the upper bound
+  genCopy(limitAddress, fjInstruction);
+  genFGT(bodyAddress);
   
   // Update false jump to after loop
   updateFJ(fjInstruction, getCurrentCodeAddress());
@@ -665,8 +709,8 @@ void compileArguments(ObjectNode* paramList) {
   }
 }
 
-void compileCondition(void) {
-  // Generate code for condition
+// Returns the jump taken when the condition is false, to be updated by the caller
+CodeAddress compileCondition(void) {
   Type* type1;
   Type* type2;
   TokenType op;
@@ -701,28 +745,20 @@ void compileCondition(void) {
   type2 = compileExpression();
   checkTypeEquality(type1,type2);
   
-  // Generate comparison instruction based on operator
+  // Compare and jump when the test fails
   switch (op) {
   case SB_EQ:
-    genEQ();
-    break;
+    return genFEQ(DC_VALUE);
   case SB_NEQ:
-    genNE();
-    break;
+    return genFNE(DC_VALUE);
   case SB_LE:
-    genLE();
-    break;
+    return genFLE(DC_VALUE);
   case SB_LT:
-    genLT();
-    break;
+    return genFLT(DC_VALUE);
   case SB_GE:
-    genGE();
-    break;
-  case SB_GT:
-    genGT();
-    break;
+    return genFGE(DC_VALUE);
   default:
-    break;
+    return genFGT(DC_VALUE);
   }
 }
 
@@ -762,7 +798,7 @@ Type* compileExpression2(void) {
 Type* compileExpression3(Type* argType1) {
   // Generate code for expression3
   Type* argType2;
-  Type* resultType;
+  Type* resultType = NULL;
 
   switch (lookAhead->tokenType) {
   case SB_PLUS:
@@ -818,7 +854,7 @@ Type* compileTerm(void) {
 Type* compileTerm2(Type* argType1) {
   // Generate code for term2
   Type* argType2;
-  Type* resultType;
+  Type* resultType = NULL;
 
   switch (lookAhead->tokenType) {
   case SB_TIMES:
@@ -867,7 +903,7 @@ Type* compileTerm2(Type* argType1) {
 
 Type* compileFactor(void) {
   // Generate code for factor
-  Type* type;
+  Type* type = NULL;
   Object* obj;
 
   switch (lookAhead->tokenType) {
@@ -908,9 +944,10 @@ Type* compileFactor(void) {
       break;
     case OBJ_VARIABLE:
       if (obj->varAttrs->type->typeClass == TP_ARRAY) {
-	// TEMPORARY: halt
+	// Push the element address, then its value
+	genVariableAddress(obj);
 	type = compileIndexes(obj->varAttrs->type);
-	genHL();
+	genLI();
       } else {
         // Push the variable value onto stack
         genVariableValue(obj);
@@ -951,17 +988,19 @@ Type* compileFactor(void) {
 }
 
 Type* compileIndexes(Type* arrayType) {
-  // TEMPORARY: halt
+  // The array address is on the stack: add index * element size for every index.
+  // Constant indexes fold into the address itself
   Type* type;
 
-  
   while (lookAhead->tokenType == SB_LSEL) {
     eat(SB_LSEL);
     type = compileExpression();
     checkIntType(type);
     checkArrayType(arrayType);
 
-    genHL();
+    genLC(sizeOfType(arrayType->elementType));
+    genML();
+    genAD();
 
     arrayType = arrayType->elementType;
     eat(SB_RSEL);
@@ -974,6 +1013,7 @@ int compile(char *fileName) {
   if (openInputStream(fileName) == IO_ERROR)
     return IO_ERROR;
 
+  initStringPool();
   currentToken = NULL;
   lookAhead = getValidToken();
 
@@ -982,8 +1022,7 @@ int compile(char *fileName) {
   compileProgram();
 
   cleanSymTab();
-  free(currentToken);
-  free(lookAhead);
+  cleanStringPool();
   closeInputStream();
   return IO_SUCCESS;
 
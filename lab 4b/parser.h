@@ -45,7 +45,7 @@ void compileWhileSt(void);
 void compileForSt(void);
 void compileArgument(Object* param);
 void compileArguments(ObjectNode* paramList);
-void compileCondition(void);
+CodeAddress compileCondition(void);
 Type* compileExpression(void);
 Type* compileExpression2(void);
 Type* compileExpression3(Type* argType1);
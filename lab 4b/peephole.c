@@ -0,0 +1,106 @@
+/*
+ * @copyright (c) 2008, Hedspi, Hanoi University of Technology
+ * @author Huu-Duc Nguyen
+ * @version 1.0
+ */
+
+#include <stdlib.h>
+#include "peephole.h"
+#include "verify.h"
+
+static CodeBlock* source;
+static char* removed;
+
+static int hasTarget(Instruction* inst) {
+  return (isJump(inst->op) || (inst->op == OP_CALL)) && (inst->q >= 0) && (inst->q < source->codeSize);
+}
+
+// Retarget jumps that land on a J; a cycle of Js is left as it is
+static void threadJumps(void) {
+  Instruction* code = source->code;
+  CodeAddress target;
+  int i, steps;
+
+  for (i = 0; i < source->codeSize; i ++) {
+    if (!isJump(code[i].op) || !hasTarget(code + i)) continue;
+    target = code[i].q;
+    for (steps = 0; (code[target].op == OP_J) && hasTarget(code + target) && (steps < source->codeSize); steps ++)
+      target = code[target].q;
+    if (steps < source->codeSize) code[i].q = target;
+  }
+}
+
+// Mark what one pass can drop; the survivors keep their addresses until compact()
+static int rewrite(void) {
+  Instruction* code = source->code;
+  int changed = 0;
+  int i;
+
+  for (i = 0; i < source->codeSize; i ++)
+    if ((code[i].op == OP_J) && (code[i].q == i + 1)) {
+      removed[i] = 1;
+      changed = 1;
+    }
+  return changed;
+}
+
+// Squeeze out removed instructions; a jump to one of them goes to the next survivor
+static void compact(void) {
+  Instruction* code = source->code;
+  CodeAddress* newAddress = (CodeAddress*) malloc((source->codeSize + 1) * sizeof(CodeAddress));
+  LineEntry* lines = source->lines;
+  int count = 0, lineCount = 0;
+  int i;
+
+  for (i = 0; i < source->codeSize; i ++) {
+    newAddress[i] = count;
+    if (!removed[i]) code[count++] = code[i];
+  }
+  newAddress[source->codeSize] = count;
+
+  for (i = 0; i < count; i ++)
+    if (isJump(code[i].op) || (code[i].op == OP_CALL))
+      if ((code[i].q >= 0) && (code[i].q <= source->codeSize)) code[i].q = newAddress[code[i].q];
+  source->entry = newAddress[source->entry];
+
+  // An entry whose instructions are all gone gives way to the next one at its address
+  for (i = 0; i < source->lineCount; i ++) {
+    lines[i].address = newAddress[lines[i].address];
+    if (lines[i].address >= count) break;
+    while ((lineCount > 0) && (lines[lineCount - 1].address == lines[i].address))
+      lineCount --;
+    if ((lineCount > 0) && (lines[lineCount - 1].line == lines[i].line) &&
+	(lines[lineCount - 1].column == lines[i].column))
+      continue;
+    lines[lineCount++] = lines[i];
+  }
+
+  source->codeSize = count;
+  source->lineCount = lineCount;
+  free(newAddress);
+}
+
+/******************************************************************/
+
+int optimizeCode(CodeBlock* codeBlock) {
+  int size = codeBlock->codeSize;
+  int changed = 1;
+  int i;
+
+  if (size == 0) return 0;
+
+  source = codeBlock;
+  removed = (char*) malloc(size);
+
+  // Each round may expose more: a J that now lands on the next instruction
+  while (changed) {
+    for (i = 0; i < codeBlock->codeSize; i ++)
+      removed[i] = 0;
+    threadJumps();
+    changed = rewrite();
+    if (changed) compact();
+  }
+
+  free(removed);
+  return size - codeBlock->codeSize;
+}
@@ -0,0 +1,27 @@
+/*
+ * @copyright (c) 2008, Hedspi, Hanoi University of Technology
+ * @author Huu-Duc Nguyen
+ * @version 1.0
+ */
+
+#ifndef __PEEPHOLE_H__
+#define __PEEPHOLE_H__
+
+#include "instructions.h"
+
+/*
+ * Pass over a whole code block, run once the program is compiled, for
+ * what the code generator cannot see while it emits (instruction pairs
+ * such as LA p,q; LI are already merged there):
+ *
+ *   a jump to a J      =>  a jump to the target of that J
+ *   J to the next one  =>  nothing
+ *
+ * Removed instructions are squeezed out, and jumps, calls, the entry and
+ * the line table are renumbered to match.
+ */
+
+// Returns the number of instructions removed
+int optimizeCode(CodeBlock* codeBlock);
+
+#endif
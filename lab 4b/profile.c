@@ -0,0 +1,187 @@
+/*
+ * @copyright (c) 2008, Hedspi, Hanoi University of Technology
+ * @author Huu-Duc Nguyen
+ * @version 1.0
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "reader.h"
+#include "profile.h"
+#include "verify.h"
+
+static long long* sortKey;       // what compareByKey() sorts indexes by
+
+// Largest first, then by index
+static int compareByKey(const void* a, const void* b) {
+  int x = *(const int*) a;
+  int y = *(const int*) b;
+
+  if (sortKey[x] != sortKey[y]) return (sortKey[x] > sortKey[y]) ? -1 : 1;
+  return x - y;
+}
+
+static int* sortedIndexes(long long* key, int n) {
+  int* index = (int*) malloc((n + 1) * sizeof(int));
+  int i;
+
+  for (i = 0; i < n; i ++)
+    index[i] = i;
+  sortKey = key;
+  qsort(index, n, sizeof(int), compareByKey);
+  return index;
+}
+
+static double percent(long long part, long long total) {
+  return (total == 0) ? 0.0 : 100.0 * part / total;
+}
+
+// A loop head is the target of a backward jump: map it to the last such jump, others to -1
+static CodeAddress* findLoopHeads(CodeBlock* codeBlock) {
+  CodeAddress* jump = (CodeAddress*) malloc((codeBlock->codeSize + 1) * sizeof(CodeAddress));
+  Instruction* inst;
+  int i;
+
+  for (i = 0; i < codeBlock->codeSize; i ++)
+    jump[i] = -1;
+  for (i = 0; i < codeBlock->codeSize; i ++) {
+    inst = codeBlock->code + i;
+    if (isJump(inst->op) && (inst->q >= 0) && (inst->q <= i)) jump[inst->q] = i;
+  }
+  return jump;
+}
+
+static void writeProcedureName(Profile* profile, FILE* f, CodeAddress start) {
+  int line, column;
+
+  if (start < 0) fprintf(f, "?");
+  else if (start == profile->codeBlock->entry) fprintf(f, "main");
+  else if (findLine(profile->codeBlock, start, &line, &column))
+    fprintf(f, "procedure at %d (line %d)", start, line);
+  else fprintf(f, "procedure at %d", start);
+}
+
+static void writeLine(Profile* profile, FILE* f, CodeAddress i) {
+  int line, column;
+
+  if (findLine(profile->codeBlock, i, &line, &column))
+    fprintf(f, "%5d:%-4d", line, column);
+  else fprintf(f, "%10s", "");
+}
+
+/******************************************************************/
+
+Profile* createProfile(CodeBlock* codeBlock) {
+  Profile* profile = (Profile*) malloc(sizeof(Profile));
+  int i;
+
+  profile->codeBlock = codeBlock;
+  profile->count = (long long*) calloc(codeBlock->codeSize + 1, sizeof(long long));
+  profile->procedure = (CodeAddress*) malloc((codeBlock->codeSize + 1) * sizeof(CodeAddress));
+  for (i = 0; i < codeBlock->codeSize; i ++)
+    profile->procedure[i] = -1;
+  return profile;
+}
+
+void freeProfile(Profile* profile) {
+  free(profile->count);
+  free(profile->procedure);
+  free(profile);
+}
+
+void writeProfileReport(Profile* profile, FILE* f) {
+  CodeBlock* codeBlock = profile->codeBlock;
+  int n = codeBlock->codeSize;
+  long long* count = profile->count;
+  long long* byOpCode = (long long*) calloc(MAX_OPCODE + 1, sizeof(long long));
+  long long* byProcedure = (long long*) calloc(n + 1, sizeof(long long));
+  long long* calls = (long long*) calloc(n + 1, sizeof(long long));
+  CodeAddress* jump = findLoopHeads(codeBlock);
+  long long total = 0;
+  Instruction* inst;
+  int* index;
+  int i, k;
+
+  for (i = 0; i < n; i ++) {
+    if (count[i] == 0) continue;
+    inst = codeBlock->code + i;
+    total += count[i];
+    byOpCode[inst->op] += count[i];
+    if (profile->procedure[i] >= 0) byProcedure[profile->procedure[i]] += count[i];
+    if (inst->op == OP_CALL) calls[inst->q] += count[i];
+  }
+
+  fprintf(f, "Profile: %lld instructions executed\n", total);
+
+  fprintf(f, "\nProcedures:\n%16s %7s %12s  %s\n", "instructions", "%", "calls", "procedure");
+  index = sortedIndexes(byProcedure, n);
+  for (k = 0; (k < n) && (byProcedure[index[k]] > 0); k ++) {
+    i = index[k];
+    fprintf(f, "%16lld %6.2f%% %12lld  ", byProcedure[i], percent(byProcedure[i], total),
+	    (i == codeBlock->entry) ? 1 : calls[i]);
+    writeProcedureName(profile, f, i);
+    fprintf(f, "\n");
+  }
+  free(index);
+
+  fprintf(f, "\nOpcodes:\n%16s %7s  %s\n", "count", "%", "opcode");
+  index = sortedIndexes(byOpCode, MAX_OPCODE + 1);
+  for (k = 0; (k <= MAX_OPCODE) && (byOpCode[index[k]] > 0); k ++)
+    fprintf(f, "%16lld %6.2f%%  %s\n", byOpCode[index[k]], percent(byOpCode[index[k]], total),
+	    opCodeName(index[k]));
+  free(index);
+
+  fprintf(f, "\nLoop heads:\n%16s %7s %7s %10s  %s\n", "iterations", "head", "jump", "source", "procedure");
+  index = sortedIndexes(count, n);
+  for (k = 0; (k < n) && (count[index[k]] > 0); k ++) {
+    i = index[k];
+    if (jump[i] < 0) continue;
+    fprintf(f, "%16lld %7d %7d ", count[i], i, jump[i]);
+    writeLine(profile, f, i);
+    fprintf(f, "  ");
+    writeProcedureName(profile, f, profile->procedure[i]);
+    fprintf(f, "\n");
+  }
+
+  fprintf(f, "\nHottest instructions:\n%16s %7s %7s %10s  %s\n", "count", "%", "address", "source", "instruction");
+  for (k = 0; (k < n) && (k < PROFILE_HOT_INSTRUCTIONS) && (count[index[k]] > 0); k ++) {
+    i = index[k];
+    fprintf(f, "%16lld %6.2f%% %7d ", count[i], percent(count[i], total), i);
+    writeLine(profile, f, i);
+    fprintf(f, "  ");
+    fprintInstruction(f, codeBlock->code + i);
+    fprintf(f, "\n");
+  }
+  free(index);
+
+  free(byOpCode);
+  free(byProcedure);
+  free(calls);
+  free(jump);
+}
+
+int writeProfileDump(Profile* profile, char* fileName) {
+  CodeBlock* codeBlock = profile->codeBlock;
+  CodeAddress* jump;
+  FILE* f;
+  int line, column;
+  int i;
+
+  f = fopen(fileName, "w");
+  if (f == NULL) return IO_ERROR;
+  jump = findLoopHeads(codeBlock);
+
+  // Line and column are 0 when the image has no line table
+  fprintf(f, "# address\topcode\tp\tq\tcount\tprocedure\tloop\tline\tcolumn\n");
+  for (i = 0; i < codeBlock->codeSize; i ++) {
+    if (profile->count[i] == 0) continue;
+    if (!findLine(codeBlock, i, &line, &column)) line = column = 0;
+    fprintf(f, "%d\t%s\t%d\t%d\t%lld\t%d\t%d\t%d\t%d\n", i, opCodeName(codeBlock->code[i].op),
+	    codeBlock->code[i].p, codeBlock->code[i].q, profile->count[i], profile->procedure[i],
+	    jump[i] >= 0, line, column);
+  }
+  free(jump);
+
+  if (fclose(f) != 0) return IO_ERROR;
+  return IO_SUCCESS;
+}
@@ -0,0 +1,39 @@
+/*
+ * @copyright (c) 2008, Hedspi, Hanoi University of Technology
+ * @author Huu-Duc Nguyen
+ * @version 1.0
+ */
+
+#ifndef __PROFILE_H__
+#define __PROFILE_H__
+
+#include <stdio.h>
+#include "instructions.h"
+
+// Instructions listed in the report, hottest first
+#define PROFILE_HOT_INSTRUCTIONS 20
+
+/*
+ * Execution counts of a run of the stack interpreter. Opcode, procedure
+ * and loop figures are all derived from the count of each address.
+ * Procedures are known by their code address: the entry for the main
+ * program, a CALL target for the others.
+ */
+
+struct Profile_ {
+  CodeBlock* codeBlock;
+  long long* count;        // executions of each address
+  CodeAddress* procedure;  // start of the procedure of each address, or -1
+};
+
+typedef struct Profile_ Profile;
+
+Profile* createProfile(CodeBlock* codeBlock);
+void freeProfile(Profile* profile);
+
+// Sorted, human readable
+void writeProfileReport(Profile* profile, FILE* f);
+// One line per executed address; returns IO_ERROR when the file can't be written
+int writeProfileDump(Profile* profile, char* fileName);
+
+#endif
@@ -5,33 +5,101 @@
  */
 
 #include <stdio.h>
+#include <stdlib.h>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
 #include "reader.h"
 
-FILE *inputStream;
-int lineNo, colNo;
-int currentChar;
+#define READ_BLOCK_SIZE 65536
 
-int readChar(void) {
-  currentChar = getc(inputStream);
-  colNo ++;
-  if (currentChar == '\n') {
-    lineNo ++;
-    colNo = 0;
+const char* inputCursor;
+const char* inputEnd;
+const char* lineStart;
+int lineNo;
+
+static char* inputBuffer;
+static long inputSize;
+static int inputMapped;
+
+// Read the whole stream in large blocks; used when it cannot be mapped
+static int readInputStream(FILE* f) {
+  long capacity = READ_BLOCK_SIZE;
+  size_t n;
+  char* buffer;
+
+  inputBuffer = (char*) malloc(capacity);
+  inputSize = 0;
+  if (inputBuffer == NULL) return IO_ERROR;
+
+  while ((n = fread(inputBuffer + inputSize, 1, capacity - inputSize, f)) > 0) {
+    inputSize += n;
+    if (inputSize == capacity) {
+      capacity *= 2;
+      buffer = (char*) realloc(inputBuffer, capacity);
+      if (buffer == NULL) return IO_ERROR;
+      inputBuffer = buffer;
+    }
   }
-  return currentChar;
+  return ferror(f) ? IO_ERROR : IO_SUCCESS;
 }
 
 int openInputStream(char *fileName) {
-  inputStream = fopen(fileName, "rt");
-  if (inputStream == NULL)
-    return IO_ERROR;
+  FILE* f;
+  int result;
+
+  inputBuffer = NULL;
+  inputSize = 0;
+  inputMapped = 0;
+
+#ifndef _WIN32
+  {
+    struct stat st;
+    int fd = open(fileName, O_RDONLY);
+    void* mapping;
+
+    if (fd < 0)
+      return IO_ERROR;
+    if ((fstat(fd, &st) == 0) && S_ISREG(st.st_mode) && (st.st_size > 0)) {
+      mapping = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (mapping != MAP_FAILED) {
+	inputBuffer = (char*) mapping;
+	inputSize = st.st_size;
+	inputMapped = 1;
+      }
+    }
+    close(fd);
+  }
+#endif
+
+  if (!inputMapped) {
+    f = fopen(fileName, "rb");
+    if (f == NULL)
+      return IO_ERROR;
+    result = readInputStream(f);
+    fclose(f);
+    if (result == IO_ERROR) {
+      free(inputBuffer);
+      return IO_ERROR;
+    }
+  }
+
+  inputCursor = inputBuffer;
+  inputEnd = inputBuffer + inputSize;
+  lineStart = inputBuffer;
   lineNo = 1;
-  colNo = 0;
-  readChar();
   return IO_SUCCESS;
 }
 
 void closeInputStream() {
-  fclose(inputStream);
+#ifndef _WIN32
+  if (inputMapped) {
+    munmap(inputBuffer, inputSize);
+    return;
+  }
+#endif
+  free(inputBuffer);
 }
-
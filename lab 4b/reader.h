@@ -10,7 +10,18 @@
 #define IO_ERROR 0
 #define IO_SUCCESS 1
 
-int readChar(void);
+/*
+ * The whole source is held in memory and the scanner walks it with
+ * inputCursor. Line numbers are counted as newlines are skipped;
+ * columns are only computed, from lineStart, where a token begins.
+ */
+extern const char* inputCursor;
+extern const char* inputEnd;
+extern const char* lineStart;
+extern int lineNo;
+
+#define COLUMN_OF(p) ((int) ((p) - lineStart) + 1)
+
 int openInputStream(char *fileName);
 void closeInputStream(void);
 
@@ -0,0 +1,504 @@
+/*
+ * @copyright (c) 2008, Hedspi, Hanoi University of Technology
+ * @author Huu-Duc Nguyen
+ * @version 1.0
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "regcode.h"
+
+#define INITIAL_REG_CODE_SIZE 256
+
+// Where the value of a pending operand stack slot can be found
+#define OPND_HOME 0              // already stored in its own slot
+#define OPND_SLOT 1              // still in the slot named by value
+#define OPND_CONST 2             // the constant value itself
+
+typedef struct {
+  int kind;
+  WORD value;
+} Operand;
+
+static CodeBlock* source;
+static RegCode* regCode;
+
+// From the verification of the source
+static int* height;
+static int* returned;
+static int* limit;
+static char* isStart;
+
+static char* isLabel;
+static CodeAddress* address;     // register address of each stack instruction
+
+static Operand* operands;        // the operand stack while translating, indexed by slot
+static int top;
+static int lazyFrom;             // every operand below this one is at home
+static int blockStart;           // first register instruction of the current basic block
+static CodeAddress current;
+
+static int max(int a, int b) {
+  return (a > b) ? a : b;
+}
+
+// Basic blocks start at procedure starts and jump targets
+static void findLabels(void) {
+  Instruction* inst;
+  int i;
+
+  for (i = 0; i < source->codeSize; i ++) {
+    inst = source->code + i;
+    if (height[i] == UNREACHED) continue;
+    if (isStart[i]) isLabel[i] = 1;
+    if (isJump(inst->op)) isLabel[inst->q] = 1;
+  }
+}
+
+/******************* Translation ******************************/
+
+static void emit(enum RegOpCode op, WORD a, WORD b, WORD c) {
+  RegInstruction* inst;
+
+  if (regCode->codeSize >= regCode->maxSize) {
+    regCode->maxSize *= 2;
+    regCode->code = (RegInstruction*) realloc(regCode->code, regCode->maxSize * sizeof(RegInstruction));
+    regCode->origin = (CodeAddress*) realloc(regCode->origin, regCode->maxSize * sizeof(CodeAddress));
+  }
+
+  inst = regCode->code + regCode->codeSize;
+  inst->op = op;
+  inst->a = a;
+  inst->b = b;
+  inst->c = c;
+  regCode->origin[regCode->codeSize ++] = current;
+}
+
+static void materialize(int slot) {
+  Operand* o = operands + slot;
+
+  if (o->kind == OPND_CONST)
+    emit(R_LOADK, slot, o->value, DC_VALUE);
+  else if (o->kind == OPND_SLOT)
+    emit(R_MOVE, slot, o->value, DC_VALUE);
+  o->kind = OPND_HOME;
+}
+
+// Store every pending operand: done at the end of each basic block
+static void flushAll(void) {
+  int i;
+
+  for (i = lazyFrom; i <= top; i ++)
+    materialize(i);
+  lazyFrom = top + 1;
+}
+
+// Operands still reading slot must take their copy before it is overwritten
+static void flushReaders(int slot) {
+  int i;
+
+  for (i = lazyFrom; i <= top; i ++)
+    if ((operands[i].kind == OPND_SLOT) && (operands[i].value == slot))
+      materialize(i);
+}
+
+// A write to slot must not be undone later by the pending operand that lives there
+static void flushSlot(int slot) {
+  if ((slot >= lazyFrom) && (slot <= top))
+    materialize(slot);
+}
+
+// Before a store whose target is not known at translation time
+static void flushSlots(void) {
+  int i;
+
+  for (i = lazyFrom; i <= top; i ++)
+    if (operands[i].kind == OPND_SLOT)
+      materialize(i);
+}
+
+// The register holding an operand, storing constants first
+static int use(int slot) {
+  if (operands[slot].kind == OPND_CONST)
+    materialize(slot);
+  return (operands[slot].kind == OPND_SLOT) ? operands[slot].value : slot;
+}
+
+static void pop(int count) {
+  top -= count;
+  if (lazyFrom > top + 1) lazyFrom = top + 1;
+}
+
+// Words removed by DCT stay in memory: they are the arguments of a call
+static void drop(int count) {
+  int i;
+
+  for (i = max(lazyFrom, top - count + 1); i <= top; i ++)
+    materialize(i);
+  pop(count);
+}
+
+static void pushHome(void) {
+  top ++;
+  operands[top].kind = OPND_HOME;
+}
+
+static void pushLazy(int kind, WORD value) {
+  top ++;
+  operands[top].kind = kind;
+  operands[top].value = value;
+  if (top < lazyFrom) lazyFrom = top;
+}
+
+/*
+ * A slot may only be read lazily when it lies below the new operand and
+ * is already at home: it can then change only through an explicit store,
+ * and every store calls flushReaders() first.
+ */
+static void pushSlot(WORD slot) {
+  if ((slot >= 0) && (slot <= top) && ((slot < lazyFrom) || (operands[slot].kind == OPND_HOME)))
+    pushLazy(OPND_SLOT, slot);
+  else {
+    pushHome();
+    emit(R_MOVE, top, slot, DC_VALUE);
+  }
+}
+
+// Can the instruction that just computed slot be made to write elsewhere?
+static int canRetarget(int slot) {
+  RegInstruction* last = regCode->code + regCode->codeSize - 1;
+
+  return (regCode->codeSize > blockStart) && (last->op <= R_RI) && (last->a == slot);
+}
+
+static int isDivision(enum OpCode op) {
+  return (op == OP_DV) || (op == OP_MOD);
+}
+
+static WORD fold(enum OpCode op, WORD x, WORD y) {
+  switch (op) {
+  case OP_AD: return (WORD) ((unsigned) x + (unsigned) y);
+  case OP_SB: return (WORD) ((unsigned) x - (unsigned) y);
+  default: return (WORD) ((unsigned) x * (unsigned) y);
+  }
+}
+
+static void translateArithmetic(enum OpCode op) {
+  static enum RegOpCode regOp[] = { R_ADD, R_SUB, R_MUL, R_DIV, R_MOD };
+  static enum RegOpCode regOpK[] = { R_ADDK, R_SUBK, R_MULK, R_DIVK, R_MODK };
+  Operand left = operands[top - 1];
+  Operand right = operands[top];
+  int n = (op == OP_MOD) ? 4 : op - OP_AD;
+  int a, c;
+
+  if ((left.kind == OPND_CONST) && (right.kind == OPND_CONST) && !isDivision(op)) {
+    pop(2);
+    pushLazy(OPND_CONST, fold(op, left.value, right.value));
+  } else if ((right.kind == OPND_CONST) && (!isDivision(op) || ((right.value != 0) && (right.value != -1)))) {
+    a = use(top - 1);
+    pop(2);
+    pushHome();
+    emit(regOpK[n], top, a, right.value);
+  } else if ((left.kind == OPND_CONST) && ((op == OP_AD) || (op == OP_ML))) {
+    a = use(top);
+    pop(2);
+    pushHome();
+    emit(regOpK[n], top, a, left.value);
+  } else {
+    c = use(top);
+    a = use(top - 1);
+    pop(2);
+    pushHome();
+    emit(regOp[n], top, a, c);
+  }
+}
+
+static void translateCompareJump(Instruction* inst) {
+  // Same test with the operands swapped, for a constant on the left
+  static enum OpCode mirror[] = { OP_FEQ, OP_FNE, OP_FLT, OP_FGT, OP_FLE, OP_FGE };
+  Operand left = operands[top - 1];
+  Operand right = operands[top];
+  int n = inst->op - OP_FEQ;
+  int a, c;
+
+  if (right.kind == OPND_CONST) {
+    a = use(top - 1);
+    pop(2);
+    flushAll();
+    emit(R_FEQK + n, a, right.value, inst->q);
+  } else if (left.kind == OPND_CONST) {
+    a = use(top);
+    pop(2);
+    flushAll();
+    emit(R_FEQK + (mirror[n] - OP_FEQ), a, left.value, inst->q);
+  } else {
+    c = use(top);
+    a = use(top - 1);
+    pop(2);
+    flushAll();
+    emit(R_FEQ + n, a, c, inst->q);
+  }
+}
+
+static void translateStore(WORD slot) {
+  Operand value = operands[top];
+
+  pop(1);
+  flushReaders(slot);
+  flushSlot(slot);
+
+  if (value.kind == OPND_CONST)
+    emit(R_LOADK, slot, value.value, DC_VALUE);
+  else if (value.kind == OPND_SLOT) {
+    if (value.value != slot)
+      emit(R_MOVE, slot, value.value, DC_VALUE);
+  } else if (canRetarget(top + 1))
+    regCode->code[regCode->codeSize - 1].a = slot;
+  else
+    emit(R_MOVE, slot, top + 1, DC_VALUE);
+}
+
+// Returns 0 when control does not fall through to the next instruction
+static int translateInstruction(Instruction* inst) {
+  int a, c, i;
+
+  switch (inst->op) {
+  case OP_LA:
+    pushHome();
+    emit(R_LA, top, inst->p, inst->q);
+    break;
+  case OP_LV:
+    if (inst->p == 0)
+      pushSlot(inst->q);
+    else {
+      pushHome();
+      emit(R_LVN, top, inst->p, inst->q);
+    }
+    break;
+  case OP_LC:
+    pushLazy(OPND_CONST, inst->q);
+    break;
+  case OP_LI:
+    a = use(top);
+    pop(1);
+    pushHome();
+    emit(R_LI, top, a, DC_VALUE);
+    break;
+  case OP_INT:
+    if (inst->q < 0) drop(- inst->q);
+    for (i = 0; i < inst->q; i ++) pushHome();
+    break;
+  case OP_DCT:
+    if (inst->q >= 0) drop(inst->q);
+    for (i = 0; i < - inst->q; i ++) pushHome();
+    break;
+  case OP_J:
+    flushAll();
+    emit(R_J, DC_VALUE, DC_VALUE, inst->q);
+    return 0;
+  case OP_FJ:
+    a = use(top);
+    pop(1);
+    flushAll();
+    emit(R_FJ, a, DC_VALUE, inst->q);
+    break;
+  case OP_HL:
+    emit(R_HL, DC_VALUE, DC_VALUE, DC_VALUE);
+    return 0;
+  case OP_ST:
+    c = use(top);
+    a = use(top - 1);
+    pop(2);
+    flushSlots();
+    emit(R_ST, a, c, DC_VALUE);
+    break;
+  case OP_CALL:
+    flushAll();
+    emit(R_CALL, top + 1, inst->p, inst->q);
+    if (returned[inst->q] == UNREACHED) return 0;
+    if (returned[inst->q]) pushHome();
+    lazyFrom = top + 1;
+    break;
+  case OP_EP:
+  case OP_EF:
+    emit(R_RET, DC_VALUE, DC_VALUE, DC_VALUE);
+    return 0;
+  case OP_RC:
+  case OP_RI:
+    pushHome();
+    emit((inst->op == OP_RC) ? R_RC : R_RI, top, DC_VALUE, DC_VALUE);
+    break;
+  case OP_WRC:
+  case OP_WRI:
+    if (operands[top].kind == OPND_CONST)
+      emit((inst->op == OP_WRC) ? R_WRCK : R_WRIK, operands[top].value, DC_VALUE, DC_VALUE);
+    else
+      emit((inst->op == OP_WRC) ? R_WRC : R_WRI, use(top), DC_VALUE, DC_VALUE);
+    pop(1);
+    break;
+  case OP_WLN:
+    emit(R_WLN, DC_VALUE, DC_VALUE, DC_VALUE);
+    break;
+  case OP_AD:
+  case OP_SB:
+  case OP_ML:
+  case OP_DV:
+  case OP_MOD:
+    translateArithmetic(inst->op);
+    break;
+  case OP_SHL:
+  case OP_SHR:
+  case OP_AND:
+    a = use(top);
+    pop(1);
+    pushHome();
+    emit((inst->op == OP_SHL) ? R_SHL : (inst->op == OP_SHR) ? R_SHR : R_AND, top, a, inst->q);
+    break;
+  case OP_NEG:
+    if (operands[top].kind == OPND_CONST)
+      operands[top].value = (WORD) (0u - (unsigned) operands[top].value);
+    else {
+      a = use(top);
+      pop(1);
+      pushHome();
+      emit(R_NEG, top, a, DC_VALUE);
+    }
+    break;
+  case OP_CV:
+    if (operands[top].kind == OPND_HOME)
+      pushSlot(top);
+    else
+      pushLazy(operands[top].kind, operands[top].value);
+    break;
+  case OP_EQ:
+  case OP_NE:
+  case OP_GT:
+  case OP_LT:
+  case OP_GE:
+  case OP_LE:
+    c = use(top);
+    a = use(top - 1);
+    pop(2);
+    pushHome();
+    emit(R_EQ + (inst->op - OP_EQ), top, a, c);
+    break;
+  case OP_BP:
+    break;
+  case OP_ADV:
+    pushSlot(inst->p);
+    pushSlot(inst->q);
+    translateArithmetic(OP_AD);
+    break;
+  case OP_INC:
+    flushReaders(inst->p);
+    flushSlot(inst->p);
+    emit(R_INC, inst->p, inst->q, DC_VALUE);
+    break;
+  case OP_LOOP:
+    // The limit was pushed before the increment, so it can't stay a lazy copy of the counter
+    flushReaders(inst->p);
+    if (operands[top].kind == OPND_CONST) {
+      c = operands[top].value;
+      pop(1);
+      flushAll();
+      emit(R_LOOPK, inst->p, c, inst->q);
+    } else {
+      c = use(top);
+      pop(1);
+      flushAll();
+      emit(R_LOOP, inst->p, c, inst->q);
+    }
+    break;
+  case OP_STL:
+    if (inst->p == 0)
+      translateStore(inst->q);
+    else {
+      a = use(top);
+      pop(1);
+      flushSlots();
+      emit(R_STN, a, inst->p, inst->q);
+    }
+    break;
+  case OP_FEQ:
+  case OP_FNE:
+  case OP_FGT:
+  case OP_FLT:
+  case OP_FGE:
+  case OP_FLE:
+    translateCompareJump(inst);
+    break;
+  }
+  return 1;
+}
+
+static void translate(void) {
+  RegInstruction* inst;
+  int live = 0;
+  int i;
+
+  for (i = 0; i < source->codeSize; i ++) {
+    current = i;
+    if (height[i] == UNREACHED) {
+      live = 0;
+      continue;
+    }
+
+    if (isLabel[i]) {
+      if (live) flushAll();
+      top = height[i];
+      lazyFrom = top + 1;
+      blockStart = regCode->codeSize;
+    }
+
+    address[i] = regCode->codeSize;
+    if (isStart[i]) emit(R_CHECK, limit[i], DC_VALUE, DC_VALUE);
+    live = translateInstruction(source->code + i);
+  }
+
+  for (i = 0; i < regCode->codeSize; i ++) {
+    inst = regCode->code + i;
+    if ((inst->op == R_J) || (inst->op == R_CALL) || ((inst->op >= R_FJ) && (inst->op <= R_LOOPK)))
+      inst->c = address[inst->c];
+  }
+  regCode->entry = address[source->entry];
+}
+
+/******************************************************************/
+
+RegCode* translateCode(CodeBlock* codeBlock, Verification* verification) {
+  int n = codeBlock->codeSize;
+  int maxSlot = 0;
+  int i;
+
+  source = codeBlock;
+  height = verification->height;
+  returned = verification->returned;
+  limit = verification->limit;
+  isStart = verification->isStart;
+  isLabel = (char*) calloc(n, sizeof(char));
+  address = (CodeAddress*) malloc(n * sizeof(CodeAddress));
+  findLabels();
+
+  for (i = 0; i < n; i ++)
+    if (isStart[i])
+      maxSlot = max(maxSlot, limit[i]);
+
+  regCode = (RegCode*) malloc(sizeof(RegCode));
+  regCode->maxSize = INITIAL_REG_CODE_SIZE;
+  regCode->codeSize = 0;
+  regCode->code = (RegInstruction*) malloc(regCode->maxSize * sizeof(RegInstruction));
+  regCode->origin = (CodeAddress*) malloc(regCode->maxSize * sizeof(CodeAddress));
+  operands = (Operand*) malloc((maxSlot + 2) * sizeof(Operand));
+  translate();
+
+  free(operands);
+  free(isLabel);
+  free(address);
+  return regCode;
+}
+
+void freeRegCode(RegCode* regCode) {
+  free(regCode->code);
+  free(regCode->origin);
+  free(regCode);
+}
@@ -0,0 +1,111 @@
+/*
+ * @copyright (c) 2008, Hedspi, Hanoi University of Technology
+ * @author Huu-Duc Nguyen
+ * @version 1.0
+ */
+
+#ifndef __REGCODE_H__
+#define __REGCODE_H__
+
+#include "instructions.h"
+#include "verify.h"
+
+/*
+ * Register form of a code block, built when an image is loaded.
+ *
+ * The verifier proved that the stack height relative to b is the same
+ * every time an instruction is reached, so each operand stack slot can
+ * be named by its offset in the frame: R(x) below stands for s[b + x].
+ * Loads of locals and constants are kept symbolic until an instruction
+ * consumes them, which lets AD, compares and stores read their operands
+ * in place.
+ *
+ * The first field is the destination of every instruction that defines
+ * a register; c is the jump target of jumps and calls.
+ */
+
+enum RegOpCode {
+  R_MOVE,  // R(a) := R(b);
+  R_LOADK, // R(a) := b;
+  R_LA,    // R(a) := base(b) + c;
+  R_LVN,   // R(a) := s[base(b) + c];
+  R_LI,    // R(a) := s[R(b)];
+  R_ADD,   // R(a) := R(b) + R(c);
+  R_SUB,   // R(a) := R(b) - R(c);
+  R_MUL,   // R(a) := R(b) * R(c);
+  R_DIV,   // R(a) := R(b) / R(c);
+  R_ADDK,  // R(a) := R(b) + c;
+  R_SUBK,  // R(a) := R(b) - c;
+  R_MULK,  // R(a) := R(b) * c;
+  R_DIVK,  // R(a) := R(b) / c;
+  R_MOD,   // R(a) := R(b) mod R(c);
+  R_MODK,  // R(a) := R(b) mod c;
+  R_SHL,   // R(a) := R(b) * 2^c;
+  R_SHR,   // R(a) := R(b) / 2^c;
+  R_AND,   // R(a) := R(b) & c;
+  R_NEG,   // R(a) := - R(b);
+  R_EQ,    // R(a) := R(b) = R(c);
+  R_NE,    // R(a) := R(b) != R(c);
+  R_GT,    // R(a) := R(b) > R(c);
+  R_LT,    // R(a) := R(b) < R(c);
+  R_GE,    // R(a) := R(b) >= R(c);
+  R_LE,    // R(a) := R(b) <= R(c);
+  R_RC,    // read one character into R(a);
+  R_RI,    // read integer into R(a);
+
+  R_ST,    // s[R(a)] := R(b);
+  R_STN,   // s[base(b) + c] := R(a);
+  R_INC,   // R(a) := R(a) + b;
+  R_WRC,   // write one character from R(a);
+  R_WRI,   // write integer from R(a);
+  R_WRCK,  // write the character a;
+  R_WRIK,  // write the integer a;
+  R_WLN,   // CR/LF
+
+  R_J,     // pc := c;
+  R_FJ,    // if R(a) = 0 then pc := c;
+  R_FEQ,   // if R(a) != R(b) then pc := c;
+  R_FNE,   // if R(a) = R(b) then pc := c;
+  R_FGT,   // if R(a) <= R(b) then pc := c;
+  R_FLT,   // if R(a) >= R(b) then pc := c;
+  R_FGE,   // if R(a) < R(b) then pc := c;
+  R_FLE,   // if R(a) > R(b) then pc := c;
+  R_FEQK,  // if R(a) != b then pc := c;
+  R_FNEK,  // if R(a) = b then pc := c;
+  R_FGTK,  // if R(a) <= b then pc := c;
+  R_FLTK,  // if R(a) >= b then pc := c;
+  R_FGEK,  // if R(a) < b then pc := c;
+  R_FLEK,  // if R(a) > b then pc := c;
+  R_LOOP,  // R(a) := R(a) + 1; if R(a) <= R(b) then pc := c;
+  R_LOOPK, // R(a) := R(a) + 1; if R(a) <= b then pc := c;
+  R_CALL,  // new frame at b + a: DL, RA and SL := base(b); b := b + a; pc := c;
+  R_RET,   // pc := s[b+2]; b := s[b+1];
+  R_CHECK, // stack overflow unless b + a < stack size
+  R_HL     // Halt
+};
+
+struct RegInstruction_ {
+  enum RegOpCode op;
+  WORD a;
+  WORD b;
+  WORD c;
+};
+
+typedef struct RegInstruction_ RegInstruction;
+
+struct RegCode_ {
+  RegInstruction* code;
+  int codeSize;
+  int maxSize;
+
+  CodeAddress entry;
+  CodeAddress* origin;     // address of the stack instruction each one came from
+};
+
+typedef struct RegCode_ RegCode;
+
+// The heights proved by the verifier name the slots
+RegCode* translateCode(CodeBlock* codeBlock, Verification* verification);
+void freeRegCode(RegCode* regCode);
+
+#endif
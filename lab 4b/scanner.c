@@ -13,25 +13,34 @@
 #include "token.h"
 #include "error.h"
 #include "scanner.h"
+#include "strpool.h"
 
 
-extern int lineNo;
-extern int colNo;
-extern int currentChar;
-
 extern CharCode charCodes[];
 
+#define CHAR_CODE(p) (charCodes[(unsigned char) *(p)])
+
 /***************************************************************/
 
 void skipBlank() {
-  while ((currentChar != EOF) && (charCodes[currentChar] == CHAR_SPACE))
-    readChar();
+  const char* p = inputCursor;
+
+  while ((p < inputEnd) && (CHAR_CODE(p) == CHAR_SPACE)) {
+    if (*p == '\n') {
+      lineNo ++;
+      lineStart = p + 1;
+    }
+    p ++;
+  }
+  inputCursor = p;
 }
 
 void skipComment() {
+  const char* p = inputCursor;
   int state = 0;
-  while ((currentChar != EOF) && (state < 2)) {
-    switch (charCodes[currentChar]) {
+
+  while ((p < inputEnd) && (state < 2)) {
+    switch (CHAR_CODE(p)) {
     case CHAR_TIMES:
       state = 1;
       break;
@@ -40,207 +49,187 @@ void skipComment() {
       else state = 0;
       break;
     default:
+      if (*p == '\n') {
+	lineNo ++;
+	lineStart = p + 1;
+      }
       state = 0;
     }
-    readChar();
+    p ++;
   }
+  inputCursor = p;
   if (state != 2) 
-    error(ERR_END_OF_COMMENT, lineNo, colNo);
+    error(ERR_END_OF_COMMENT, lineNo, COLUMN_OF(p));
 }
 
 Token* readIdentKeyword(void) {
-  Token *token = makeToken(TK_NONE, lineNo, colNo);
-  int count = 1;
-
-  token->string[0] = toupper((char)currentChar);
-  readChar();
-
-  while ((currentChar != EOF) && 
-	 ((charCodes[currentChar] == CHAR_LETTER) || (charCodes[currentChar] == CHAR_DIGIT))) {
-    if (count <= MAX_IDENT_LEN) token->string[count++] = toupper((char)currentChar);
-    readChar();
-  }
-
+  const char* start = inputCursor;
+  const char* p = start + 1;
+  Token *token = makeToken(TK_NONE, lineNo, COLUMN_OF(start));
+  char string[MAX_IDENT_LEN + 1];
+  int count, i;
+
+  while ((p < inputEnd) && 
+	 ((CHAR_CODE(p) == CHAR_LETTER) || (CHAR_CODE(p) == CHAR_DIGIT)))
+    p ++;
+  inputCursor = p;
+
+  count = p - start;
   if (count > MAX_IDENT_LEN) {
     error(ERR_IDENT_TOO_LONG, token->lineNo, token->colNo);
     return token;
   }
 
-  token->string[count] = '\0';
-  token->tokenType = checkKeyword(token->string);
+  for (i = 0; i < count; i ++)
+    string[i] = toupper((unsigned char) start[i]);
+  string[count] = '\0';
+  token->tokenType = checkKeyword(string);
 
-  if (token->tokenType == TK_NONE)
+  if (token->tokenType == TK_NONE) {
     token->tokenType = TK_IDENT;
+    token->string = internString(string, count);
+  }
 
   return token;
 }
 
 Token* readNumber(void) {
-  Token *token = makeToken(TK_NUMBER, lineNo, colNo);
-  int count = 0;
-
-  while ((currentChar != EOF) && (charCodes[currentChar] == CHAR_DIGIT)) {
-    token->string[count++] = (char)currentChar;
-    readChar();
+  const char* start = inputCursor;
+  const char* p = start;
+  Token *token = makeToken(TK_NUMBER, lineNo, COLUMN_OF(start));
+  int value = 0;
+  int count;
+
+  while ((p < inputEnd) && (CHAR_CODE(p) == CHAR_DIGIT)) {
+    value = value * 10 + (*p - '0');
+    p ++;
   }
+  inputCursor = p;
 
-  token->string[count] = '\0';
-  token->value = atoi(token->string);
+  count = p - start;
+  if (count > MAX_IDENT_LEN) count = MAX_IDENT_LEN;
+  token->string = internString(start, count);
+  token->value = value;
   return token;
 }
 
 Token* readConstChar(void) {
-  Token *token = makeToken(TK_CHAR, lineNo, colNo);
+  const char* p = inputCursor;
+  Token *token = makeToken(TK_CHAR, lineNo, COLUMN_OF(p));
 
-  readChar();
-  if (currentChar == EOF) {
+  p ++;
+  if (p >= inputEnd) {
+    inputCursor = p;
     token->tokenType = TK_NONE;
     error(ERR_INVALID_CONSTANT_CHAR, token->lineNo, token->colNo);
     return token;
   }
     
-  token->string[0] = currentChar;
-  token->string[1] = '\0';
-  token->value = currentChar;
+  token->string = internString(p, 1);
+  token->value = (unsigned char) *p;
+  if (*p == '\n') {
+    lineNo ++;
+    lineStart = p + 1;
+  }
 
-  readChar();
-  if (currentChar == EOF) {
+  p ++;
+  if (p >= inputEnd) {
+    inputCursor = p;
     token->tokenType = TK_NONE;
     error(ERR_INVALID_CONSTANT_CHAR, token->lineNo, token->colNo);
     return token;
   }
 
-  if (charCodes[currentChar] == CHAR_SINGLEQUOTE) {
-    readChar();
+  if (CHAR_CODE(p) == CHAR_SINGLEQUOTE) {
+    inputCursor = p + 1;
     return token;
   } else {
+    inputCursor = p;
     token->tokenType = TK_NONE;
     error(ERR_INVALID_CONSTANT_CHAR, token->lineNo, token->colNo);
     return token;
   }
 }
 
+// Single character symbols: the token starts and ends at the cursor
+static Token* readSymbol(TokenType tokenType) {
+  Token* token = makeToken(tokenType, lineNo, COLUMN_OF(inputCursor));
+  inputCursor ++;
+  return token;
+}
+
+// Symbols that may be followed by one more character, e.g. "<" and "<="
+static Token* readSymbol2(CharCode second, TokenType longType, TokenType shortType) {
+  int ln = lineNo;
+  int cn = COLUMN_OF(inputCursor);
+
+  inputCursor ++;
+  if ((inputCursor < inputEnd) && (CHAR_CODE(inputCursor) == second)) {
+    inputCursor ++;
+    return makeToken(longType, ln, cn);
+  } else return makeToken(shortType, ln, cn);
+}
+
 Token* getToken(void) {
   Token *token;
   int ln, cn;
 
-  if (currentChar == EOF) 
-    return makeToken(TK_EOF, lineNo, colNo);
+  if (inputCursor >= inputEnd) 
+    return makeToken(TK_EOF, lineNo, COLUMN_OF(inputCursor));
 
-  switch (charCodes[currentChar]) {
+  switch (CHAR_CODE(inputCursor)) {
   case CHAR_SPACE: skipBlank(); return getToken();
   case CHAR_LETTER: return readIdentKeyword();
   case CHAR_DIGIT: return readNumber();
-  case CHAR_PLUS: 
-    token = makeToken(SB_PLUS, lineNo, colNo);
-    readChar(); 
-    return token;
-  case CHAR_MINUS:
-    token = makeToken(SB_MINUS, lineNo, colNo);
-    readChar(); 
-    return token;
-  case CHAR_TIMES:
-    token = makeToken(SB_TIMES, lineNo, colNo);
-    readChar(); 
-    return token;
-  case CHAR_SLASH:
-    token = makeToken(SB_SLASH, lineNo, colNo);
-    readChar(); 
-    return token;
-  case CHAR_LT:
-    ln = lineNo;
-    cn = colNo;
-    readChar();
-    if ((currentChar != EOF) && (charCodes[currentChar] == CHAR_EQ)) {
-      readChar();
-      return makeToken(SB_LE, ln, cn);
-    } else return makeToken(SB_LT, ln, cn);
-  case CHAR_GT:
-    ln = lineNo;
-    cn = colNo;
-    readChar();
-    if ((currentChar != EOF) && (charCodes[currentChar] == CHAR_EQ)) {
-      readChar();
-      return makeToken(SB_GE, ln, cn);
-    } else return makeToken(SB_GT, ln, cn);
-  case CHAR_EQ: 
-    token = makeToken(SB_EQ, lineNo, colNo);
-    readChar(); 
-    return token;
+  case CHAR_PLUS: return readSymbol(SB_PLUS);
+  case CHAR_MINUS: return readSymbol(SB_MINUS);
+  case CHAR_TIMES: return readSymbol(SB_TIMES);
+  case CHAR_SLASH: return readSymbol(SB_SLASH);
+  case CHAR_LT: return readSymbol2(CHAR_EQ, SB_LE, SB_LT);
+  case CHAR_GT: return readSymbol2(CHAR_EQ, SB_GE, SB_GT);
+  case CHAR_EQ: return readSymbol(SB_EQ);
   case CHAR_EXCLAIMATION:
-    ln = lineNo;
-    cn = colNo;
-    readChar();
-    if ((currentChar != EOF) && (charCodes[currentChar] == CHAR_EQ)) {
-      readChar();
-      return makeToken(SB_NEQ, ln, cn);
-    } else {
-      token = makeToken(TK_NONE, ln, cn);
-      error(ERR_INVALID_SYMBOL, ln, cn);
-      return token;
-    }
-  case CHAR_COMMA:
-    token = makeToken(SB_COMMA, lineNo, colNo);
-    readChar(); 
-    return token;
-  case CHAR_PERIOD:
-    ln = lineNo;
-    cn = colNo;
-    readChar();
-    if ((currentChar != EOF) && (charCodes[currentChar] == CHAR_RPAR)) {
-      readChar();
-      return makeToken(SB_RSEL, ln, cn);
-    } else return makeToken(SB_PERIOD, ln, cn);
-  case CHAR_SEMICOLON:
-    token = makeToken(SB_SEMICOLON, lineNo, colNo);
-    readChar(); 
+    token = readSymbol2(CHAR_EQ, SB_NEQ, TK_NONE);
+    if (token->tokenType == TK_NONE)
+      error(ERR_INVALID_SYMBOL, token->lineNo, token->colNo);
     return token;
-  case CHAR_COLON:
-    ln = lineNo;
-    cn = colNo;
-    readChar();
-    if ((currentChar != EOF) && (charCodes[currentChar] == CHAR_EQ)) {
-      readChar();
-      return makeToken(SB_ASSIGN, ln, cn);
-    } else return makeToken(SB_COLON, ln, cn);
+  case CHAR_COMMA: return readSymbol(SB_COMMA);
+  case CHAR_PERIOD: return readSymbol2(CHAR_RPAR, SB_RSEL, SB_PERIOD);
+  case CHAR_SEMICOLON: return readSymbol(SB_SEMICOLON);
+  case CHAR_COLON: return readSymbol2(CHAR_EQ, SB_ASSIGN, SB_COLON);
   case CHAR_SINGLEQUOTE: return readConstChar();
   case CHAR_LPAR:
     ln = lineNo;
-    cn = colNo;
-    readChar();
+    cn = COLUMN_OF(inputCursor);
+    inputCursor ++;
 
-    if (currentChar == EOF) 
+    if (inputCursor >= inputEnd) 
       return makeToken(SB_LPAR, ln, cn);
 
-    switch (charCodes[currentChar]) {
+    switch (CHAR_CODE(inputCursor)) {
     case CHAR_PERIOD:
-      readChar();
+      inputCursor ++;
       return makeToken(SB_LSEL, ln, cn);
     case CHAR_TIMES:
-      readChar();
+      inputCursor ++;
       skipComment();
       return getToken();
     default:
       return makeToken(SB_LPAR, ln, cn);
     }
-  case CHAR_RPAR:
-    token = makeToken(SB_RPAR, lineNo, colNo);
-    readChar(); 
-    return token;
+  case CHAR_RPAR: return readSymbol(SB_RPAR);
   default:
-    token = makeToken(TK_NONE, lineNo, colNo);
-    error(ERR_INVALID_SYMBOL, lineNo, colNo);
-    readChar(); 
+    token = readSymbol(TK_NONE);
+    error(ERR_INVALID_SYMBOL, token->lineNo, token->colNo);
     return token;
   }
 }
 
 Token* getValidToken(void) {
   Token *token = getToken();
-  while (token->tokenType == TK_NONE) {
-    free(token);
+  while (token->tokenType == TK_NONE)
     token = getToken();
-  }
+  acceptToken();
   return token;
 }
 
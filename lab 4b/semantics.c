@@ -18,17 +18,17 @@ Object* lookupObject(char *name) {
   Object* obj;
 
   while (scope != NULL) {
-    obj = findObject(scope->objList, name);
+    obj = findTableObject(scope->objTable, name);
     if (obj != NULL) return obj;
     scope = scope->outer;
   }
-  obj = findObject(symtab->globalObjectList, name);
+  obj = findTableObject(symtab->globalObjectTable, name);
   if (obj != NULL) return obj;
   return NULL;
 }
 
 void checkFreshIdent(char *name) {
-  if (findObject(symtab->currentScope->objList, name) != NULL)
+  if (findTableObject(symtab->currentScope->objTable, name) != NULL)
     error(ERR_DUPLICATE_IDENT, currentToken->lineNo, currentToken->colNo);
 }
 
@@ -0,0 +1,132 @@
+/* 
+ * @copyright (c) 2008, Hedspi, Hanoi University of Technology
+ * @author Huu-Duc Nguyen
+ * @version 1.0
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "strpool.h"
+
+#define CHUNK_SIZE 65536
+#define INITIAL_SLOTS 1024
+
+/*
+ * Every distinct lexeme is stored once, NUL terminated, in large chunks
+ * that are only released by cleanStringPool(). An open addressing table
+ * maps the text to its copy, so equal strings share one pointer.
+ */
+
+struct Chunk_ {
+  struct Chunk_* next;
+  int used;
+  char text[CHUNK_SIZE];
+};
+
+typedef struct Chunk_ Chunk;
+
+struct Slot_ {
+  char* string;
+  int length;
+  unsigned int hash;
+};
+
+typedef struct Slot_ Slot;
+
+static Chunk* chunks = NULL;
+static Slot* slots = NULL;
+static int slotCount = 0;
+static int stringCount = 0;
+
+static unsigned int hashString(const char* string, int length) {
+  unsigned int h = 2166136261u;
+  int i;
+
+  for (i = 0; i < length; i ++) {
+    h ^= (unsigned char) string[i];
+    h *= 16777619u;
+  }
+  return h;
+}
+
+static char* storeString(const char* string, int length) {
+  Chunk* chunk;
+  char* copy;
+
+  if ((chunks == NULL) || (chunks->used + length + 1 > CHUNK_SIZE)) {
+    chunk = (Chunk*) malloc(sizeof(Chunk));
+    chunk->next = chunks;
+    chunk->used = 0;
+    chunks = chunk;
+  }
+
+  copy = chunks->text + chunks->used;
+  memcpy(copy, string, length);
+  copy[length] = '\0';
+  chunks->used += length + 1;
+  return copy;
+}
+
+static void growSlots(void) {
+  Slot* old = slots;
+  int oldCount = slotCount;
+  int i, j;
+
+  slotCount = (oldCount == 0) ? INITIAL_SLOTS : oldCount * 2;
+  slots = (Slot*) calloc(slotCount, sizeof(Slot));
+
+  for (i = 0; i < oldCount; i ++)
+    if (old[i].string != NULL) {
+      j = old[i].hash & (slotCount - 1);
+      while (slots[j].string != NULL)
+	j = (j + 1) & (slotCount - 1);
+      slots[j] = old[i];
+    }
+  free(old);
+}
+
+void initStringPool(void) {
+  chunks = NULL;
+  slots = NULL;
+  slotCount = 0;
+  stringCount = 0;
+  growSlots();
+}
+
+void cleanStringPool(void) {
+  Chunk* chunk;
+
+  while (chunks != NULL) {
+    chunk = chunks;
+    chunks = chunks->next;
+    free(chunk);
+  }
+  free(slots);
+  slots = NULL;
+  slotCount = 0;
+  stringCount = 0;
+}
+
+char* internString(const char* string, int length) {
+  unsigned int hash = hashString(string, length);
+  int i = hash & (slotCount - 1);
+  char* copy;
+
+  while (slots[i].string != NULL) {
+    if ((slots[i].hash == hash) && (slots[i].length == length) &&
+	(memcmp(slots[i].string, string, length) == 0))
+      return slots[i].string;
+    i = (i + 1) & (slotCount - 1);
+  }
+
+  copy = storeString(string, length);
+  slots[i].string = copy;
+  slots[i].length = length;
+  slots[i].hash = hash;
+  stringCount ++;
+
+  // Keep the table at most half full
+  if (stringCount * 2 > slotCount)
+    growSlots();
+  return copy;
+}
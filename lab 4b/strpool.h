@@ -0,0 +1,15 @@
+/* 
+ * @copyright (c) 2008, Hedspi, Hanoi University of Technology
+ * @author Huu-Duc Nguyen
+ * @version 1.0
+ */
+
+#ifndef __STRPOOL_H__
+#define __STRPOOL_H__
+
+void initStringPool(void);
+void cleanStringPool(void);
+
+char* internString(const char* string, int length);
+
+#endif
@@ -10,6 +10,7 @@
 #include "symtab.h"
 #include "error.h"
 #include "codegen.h"
+#include "strpool.h"
 
 void freeObject(Object* obj);
 void freeScope(Scope* scope);
@@ -123,6 +124,8 @@ ConstantValue* duplicateConstantValue(ConstantValue* v) {
 Scope* createScope(Object* owner) {
   Scope* scope = (Scope*) malloc(sizeof(Scope));
   scope->objList = NULL;
+  scope->objTail = NULL;
+  scope->objTable = createObjectTable();
   scope->owner = owner;
   scope->outer = NULL;
   scope->frameSize = RESERVED_WORDS;
@@ -131,7 +134,7 @@ Scope* createScope(Object* owner) {
 
 Object* createProgramObject(char *programName) {
   Object* program = (Object*) malloc(sizeof(Object));
-  strcpy(program->name, programName);
+  program->name = programName;
   program->kind = OBJ_PROGRAM;
   program->progAttrs = (ProgramAttributes*) malloc(sizeof(ProgramAttributes));
   program->progAttrs->scope = createScope(program);
@@ -143,7 +146,7 @@ Object* createProgramObject(char *programName) {
 
 Object* createConstantObject(char *name) {
   Object* obj = (Object*) malloc(sizeof(Object));
-  strcpy(obj->name, name);
+  obj->name = name;
   obj->kind = OBJ_CONSTANT;
   obj->constAttrs = (ConstantAttributes*) malloc(sizeof(ConstantAttributes));
   return obj;
@@ -151,7 +154,7 @@ Object* createConstantObject(char *name) {
 
 Object* createTypeObject(char *name) {
   Object* obj = (Object*) malloc(sizeof(Object));
-  strcpy(obj->name, name);
+  obj->name = name;
   obj->kind = OBJ_TYPE;
   obj->typeAttrs = (TypeAttributes*) malloc(sizeof(TypeAttributes));
   return obj;
@@ -159,7 +162,7 @@ Object* createTypeObject(char *name) {
 
 Object* createVariableObject(char *name) {
   Object* obj = (Object*) malloc(sizeof(Object));
-  strcpy(obj->name, name);
+  obj->name = name;
   obj->kind = OBJ_VARIABLE;
   obj->varAttrs = (VariableAttributes*) malloc(sizeof(VariableAttributes));
   obj->varAttrs->type = NULL;
@@ -170,11 +173,12 @@ Object* createVariableObject(char *name) {
 
 Object* createFunctionObject(char *name) {
   Object* obj = (Object*) malloc(sizeof(Object));
-  strcpy(obj->name, name);
+  obj->name = name;
   obj->kind = OBJ_FUNCTION;
   obj->funcAttrs = (FunctionAttributes*) malloc(sizeof(FunctionAttributes));
   obj->funcAttrs->returnType = NULL;
   obj->funcAttrs->paramList = NULL;
+  obj->funcAttrs->paramTail = NULL;
   obj->funcAttrs->paramCount = 0;
   obj->funcAttrs->codeAddress = DC_VALUE;
   obj->funcAttrs->scope = createScope(obj);
@@ -183,10 +187,11 @@ Object* createFunctionObject(char *name) {
 
 Object* createProcedureObject(char *name) {
   Object* obj = (Object*) malloc(sizeof(Object));
-  strcpy(obj->name, name);
+  obj->name = name;
   obj->kind = OBJ_PROCEDURE;
   obj->procAttrs = (ProcedureAttributes*) malloc(sizeof(ProcedureAttributes));
   obj->procAttrs->paramList = NULL;
+  obj->procAttrs->paramTail = NULL;
   obj->procAttrs->paramCount = 0;
   obj->procAttrs->codeAddress = DC_VALUE;
   obj->procAttrs->scope = createScope(obj);
@@ -195,7 +200,7 @@ Object* createProcedureObject(char *name) {
 
 Object* createParameterObject(char *name, enum ParamKind kind) {
   Object* obj = (Object*) malloc(sizeof(Object));
-  strcpy(obj->name, name);
+  obj->name = name;
   obj->kind = OBJ_PARAMETER;
   obj->paramAttrs = (ParameterAttributes*) malloc(sizeof(ParameterAttributes));
   obj->paramAttrs->kind = kind;
@@ -243,6 +248,7 @@ void freeObject(Object* obj) {
 
 void freeScope(Scope* scope) {
   freeObjectList(scope->objList);
+  freeObjectTable(scope->objTable);
   free(scope);
 }
 
@@ -267,29 +273,100 @@ void freeReferenceList(ObjectNode *objList) {
   }
 }
 
-void addObject(ObjectNode **objList, Object* obj) {
+// Append in O(1); objTail always points at the last node of objList
+void addObject(ObjectNode **objList, ObjectNode **objTail, Object* obj) {
   ObjectNode* node = (ObjectNode*) malloc(sizeof(ObjectNode));
   node->object = obj;
   node->next = NULL;
   if ((*objList) == NULL) 
     *objList = node;
-  else {
-    ObjectNode *n = *objList;
-    while (n->next != NULL) 
-      n = n->next;
-    n->next = node;
-  }
+  else
+    (*objTail)->next = node;
+  *objTail = node;
 }
 
 Object* findObject(ObjectNode *objList, char *name) {
   while (objList != NULL) {
-    if (strcmp(objList->object->name, name) == 0) 
+    if (objList->object->name == name) 
       return objList->object;
     else objList = objList->next;
   }
   return NULL;
 }
 
+/******************* Object tables ******************************/
+
+#define INITIAL_BUCKET_COUNT 8
+
+// Names are interned, so the pointer itself identifies the name
+static unsigned int hashName(char *name) {
+  unsigned long h = (unsigned long) name;
+
+  h *= 2654435761u;
+  return (unsigned int) (h ^ (h >> 15));
+}
+
+ObjectTable* createObjectTable(void) {
+  ObjectTable* table = (ObjectTable*) malloc(sizeof(ObjectTable));
+  table->bucketCount = INITIAL_BUCKET_COUNT;
+  table->buckets = (ObjectNode**) calloc(table->bucketCount, sizeof(ObjectNode*));
+  table->objectCount = 0;
+  return table;
+}
+
+// Releases the index only; the objects belong to the scope's object list
+void freeObjectTable(ObjectTable* table) {
+  int i;
+  for (i = 0; i < table->bucketCount; i ++)
+    freeReferenceList(table->buckets[i]);
+  free(table->buckets);
+  free(table);
+}
+
+static void growObjectTable(ObjectTable* table) {
+  ObjectNode** buckets = table->buckets;
+  int bucketCount = table->bucketCount;
+  ObjectNode* node;
+  int i, h;
+
+  table->bucketCount = bucketCount * 2;
+  table->buckets = (ObjectNode**) calloc(table->bucketCount, sizeof(ObjectNode*));
+  for (i = 0; i < bucketCount; i ++)
+    while (buckets[i] != NULL) {
+      node = buckets[i];
+      buckets[i] = node->next;
+      h = hashName(node->object->name) & (table->bucketCount - 1);
+      node->next = table->buckets[h];
+      table->buckets[h] = node;
+    }
+  free(buckets);
+}
+
+void addTableObject(ObjectTable* table, Object* obj) {
+  ObjectNode* node = (ObjectNode*) malloc(sizeof(ObjectNode));
+  int h;
+
+  if (table->objectCount >= table->bucketCount)
+    growObjectTable(table);
+
+  h = hashName(obj->name) & (table->bucketCount - 1);
+  node->object = obj;
+  node->next = table->buckets[h];
+  table->buckets[h] = node;
+  table->objectCount ++;
+}
+
+Object* findTableObject(ObjectTable* table, char *name) {
+  ObjectNode* node = table->buckets[hashName(name) & (table->bucketCount - 1)];
+
+  while (node != NULL) {
+    if (node->object->name == name)
+      return node->object;
+    node = node->next;
+  }
+  return NULL;
+}
+
 /******************* others ******************************/
 
 void initSymTab(void) {
@@ -297,35 +374,37 @@ void initSymTab(void) {
 
   symtab = (SymTab*) malloc(sizeof(SymTab));
   symtab->globalObjectList = NULL;
+  symtab->globalObjectTail = NULL;
+  symtab->globalObjectTable = createObjectTable();
   symtab->program = NULL;
   symtab->currentScope = NULL;
   
-  readcFunction = createFunctionObject("READC");
+  readcFunction = createFunctionObject(internString("READC", 5));
   declareObject(readcFunction);
   readcFunction->funcAttrs->returnType = makeCharType();
 
-  readiFunction = createFunctionObject("READI");
+  readiFunction = createFunctionObject(internString("READI", 5));
   declareObject(readiFunction);
   readiFunction->funcAttrs->returnType = makeIntType();
 
 
-  writeiProcedure = createProcedureObject("WRITEI");
+  writeiProcedure = createProcedureObject(internString("WRITEI", 6));
   declareObject(writeiProcedure);
   enterBlock(writeiProcedure->procAttrs->scope);
-    param = createParameterObject("i", PARAM_VALUE);
+    param = createParameterObject(internString("i", 1), PARAM_VALUE);
     param->paramAttrs->type = makeIntType();
     declareObject(param);
   exitBlock();
 
-  writecProcedure = createProcedureObject("WRITEC");
+  writecProcedure = createProcedureObject(internString("WRITEC", 6));
   declareObject(writecProcedure);
   enterBlock(writecProcedure->procAttrs->scope);
-    param = createParameterObject("ch", PARAM_VALUE);
+    param = createParameterObject(internString("ch", 2), PARAM_VALUE);
     param->paramAttrs->type = makeCharType();
     declareObject(param);
   exitBlock();
 
-  writelnProcedure = createProcedureObject("WRITELN");
+  writelnProcedure = createProcedureObject(internString("WRITELN", 7));
   declareObject(writelnProcedure);
 
   intType = makeIntType();
@@ -335,6 +414,7 @@ void initSymTab(void) {
 void cleanSymTab(void) {
   freeObject(symtab->program);
   freeObjectList(symtab->globalObjectList);
+  freeObjectTable(symtab->globalObjectTable);
   free(symtab);
   freeType(intType);
   freeType(charType);
@@ -351,9 +431,10 @@ void exitBlock(void) {
 void declareObject(Object* obj) {
   Object* owner;
 
-  if (symtab->currentScope == NULL)  //  globalObject
-    addObject(&(symtab->globalObjectList), obj);
-  else {
+  if (symtab->currentScope == NULL) {  //  globalObject
+    addObject(&(symtab->globalObjectList), &(symtab->globalObjectTail), obj);
+    addTableObject(symtab->globalObjectTable, obj);
+  } else {
     switch (obj->kind) {
     case OBJ_VARIABLE:
       obj->varAttrs->scope = symtab->currentScope;
@@ -367,11 +448,11 @@ void declareObject(Object* obj) {
       owner = symtab->currentScope->owner;
       switch (owner->kind) {
       case OBJ_FUNCTION:
-	addObject(&(owner->funcAttrs->paramList), obj);
+	addObject(&(owner->funcAttrs->paramList), &(owner->funcAttrs->paramTail), obj);
 	owner->funcAttrs->paramCount ++;
 	break;
       case OBJ_PROCEDURE:
-	addObject(&(owner->procAttrs->paramList), obj);
+	addObject(&(owner->procAttrs->paramList), &(owner->procAttrs->paramTail), obj);
 	owner->procAttrs->paramCount ++;
 	break;
       default:
@@ -386,7 +467,8 @@ void declareObject(Object* obj) {
       break;
     default: break;
     }
-    addObject(&(symtab->currentScope->objList), obj);
+    addObject(&(symtab->currentScope->objList), &(symtab->currentScope->objTail), obj);
+    addTableObject(symtab->currentScope->objTable, obj);
   }
   
 }
@@ -72,6 +72,7 @@ struct TypeAttributes_ {
 
 struct ProcedureAttributes_ {
   struct ObjectNode_ *paramList;
+  struct ObjectNode_ *paramTail;
   struct Scope_* scope;
 
   int paramCount;
@@ -80,6 +81,7 @@ struct ProcedureAttributes_ {
 
 struct FunctionAttributes_ {
   struct ObjectNode_ *paramList;
+  struct ObjectNode_ *paramTail;
   Type* returnType;
   struct Scope_ *scope;
 
@@ -109,7 +111,7 @@ typedef struct ProgramAttributes_ ProgramAttributes;
 typedef struct ParameterAttributes_ ParameterAttributes;
 
 struct Object_ {
-  char name[MAX_IDENT_LEN];
+  char *name;                   // interned: equal names are the same pointer
   enum ObjectKind kind;
   union {
     ConstantAttributes* constAttrs;
@@ -131,8 +133,19 @@ struct ObjectNode_ {
 
 typedef struct ObjectNode_ ObjectNode;
 
+// Hash index over the objects of a scope; the ObjectNode list keeps their order
+struct ObjectTable_ {
+  ObjectNode **buckets;
+  int bucketCount;
+  int objectCount;
+};
+
+typedef struct ObjectTable_ ObjectTable;
+
 struct Scope_ {
   ObjectNode *objList;
+  ObjectNode *objTail;
+  ObjectTable *objTable;
   Object *owner;
   struct Scope_ *outer;
   int frameSize;
@@ -144,6 +157,8 @@ struct SymTab_ {
   Object* program;
   Scope* currentScope;
   ObjectNode *globalObjectList;
+  ObjectNode *globalObjectTail;
+  ObjectTable *globalObjectTable;
 };
 
 typedef struct SymTab_ SymTab;
@@ -162,6 +177,7 @@ ConstantValue* duplicateConstantValue(ConstantValue* v);
 
 Scope* createScope(Object* owner);
 
+// Object names must come from internString(); they are stored, not copied
 Object* createProgramObject(char *programName);
 Object* createConstantObject(char *name);
 Object* createTypeObject(char *name);
@@ -172,6 +188,11 @@ Object* createParameterObject(char *name, enum ParamKind kind);
 
 Object* findObject(ObjectNode *objList, char *name);
 
+ObjectTable* createObjectTable(void);
+void freeObjectTable(ObjectTable* table);
+void addTableObject(ObjectTable* table, Object* obj);
+Object* findTableObject(ObjectTable* table, char *name);
+
 void initSymTab(void);
 void cleanSymTab(void);
 void enterBlock(Scope* scope);
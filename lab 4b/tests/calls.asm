@@ -0,0 +1,52 @@
+; Hot procedure with a loop of its own, called 5000 times. Both the
+; calls and the backward jumps count toward compiling it, and every
+; return lands in native code again once the main loop is compiled.
+;
+; program calls;
+; var s : integer; k : integer;
+; procedure p(k : integer);
+; var j : integer;
+; begin
+;   for j := 1 to k mod 10 do s := s + j * k
+; end;
+; begin
+;   s := 0;
+;   for k := 1 to 5000 do call p(k);
+;   call writei(s); call writeln
+; end.
+0:  INT 6
+1:  LC 0
+2:  STL 0,4             ; s := 0
+3:  LC 1
+4:  STL 0,5             ; k := 1
+5:  LV 0,5
+6:  LC 5000
+7:  FLE 14
+8:  INT 4               ; links of the callee
+9:  LV 0,5              ; its parameter k
+10:  DCT 5
+11:  CALL 0,18
+12:  INC 5,1
+13:  J 5
+14:  LV 0,4
+15:  WRI
+16:  WLN
+17:  HL
+18:  INT 6
+19:  LC 1
+20:  STL 0,5            ; j := 1
+21:  LV 0,5
+22:  LV 0,4
+23:  LC 10
+24:  MOD
+25:  FLE 34
+26:  LV 1,4             ; s, one level out
+27:  LV 0,5
+28:  LV 0,4
+29:  ML
+30:  AD
+31:  STL 1,4
+32:  INC 5,1
+33:  J 21
+34:  EP
+
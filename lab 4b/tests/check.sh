@@ -0,0 +1,84 @@
+#!/bin/sh
+#
+# Regression tests, run by "make check" from the directory of the Makefile.
+#
+# tests/NAME.kpl is compiled with kplc and tests/NAME.asm assembled with
+# kplasm (tests/NAME.raw.asm into a raw image). Every image runs once in
+# each mode of kplrun, reading tests/NAME.in if there is one; what it
+# writes to stdout and stderr together must match tests/NAME.out.
+#
+# Apart from raw images, each program is also built through the C
+# backend and run natively: the images the verifier must reject are raw,
+# since the C backend refuses to write them. Its output must match tests/NAME.c.out if
+# there is one, tests/NAME.out otherwise.
+
+MODES="default -jit -stack"
+CC=${CC:-gcc}
+
+work=$(mktemp -d) || exit 1
+trap 'rm -rf "$work"' 0
+
+passed=0
+failed=0
+
+fail() {
+  echo "FAIL: $1"
+  failed=$((failed + 1))
+}
+
+# check NAME MODE EXPECTED COMMAND...: run the command on the input of NAME
+check() {
+  name=$1
+  mode=$2
+  expected=$3
+  shift 3
+  input=/dev/null
+  [ -f "tests/$name.in" ] && input="tests/$name.in"
+  "$@" < "$input" > "$work/out.txt" 2>&1
+  if cmp -s "$work/out.txt" "$expected"; then
+    passed=$((passed + 1))
+  else
+    diff "$expected" "$work/out.txt" | head -20
+    fail "$name ($mode)"
+  fi
+}
+
+for source in tests/*.kpl tests/*.asm; do
+  [ -f "$source" ] || continue
+  case "$source" in
+    *.raw.asm) name=$(basename "$source" .raw.asm); build="./kplasm $source $work/$name -raw" ;;
+    *.asm) name=$(basename "$source" .asm); build="./kplasm $source $work/$name" ;;
+    *) name=$(basename "$source" .kpl); build="./kplc $source $work/$name" ;;
+  esac
+  [ -f "tests/$name.out" ] || continue
+
+  if ! $build > "$work/build.txt" 2>&1; then
+    cat "$work/build.txt"
+    fail "$source does not build"
+    continue
+  fi
+
+  for mode in $MODES; do
+    flag=$mode
+    [ "$mode" = default ] && flag=
+    check "$name" "$mode" "tests/$name.out" ./kplrun "$work/$name" $flag
+  done
+
+  case "$source" in
+    *.raw.asm) continue ;;
+    *.asm) build="./kplasm $source $work/$name.c -c" ;;
+    *) build="./kplc $source $work/$name -emit-c" ;;
+  esac
+  if ! $build > "$work/build.txt" 2>&1 ||
+     ! $CC -O2 -o "$work/$name.native" "$work/$name.c" > "$work/build.txt" 2>&1; then
+    cat "$work/build.txt"
+    fail "$source does not build as C"
+    continue
+  fi
+  expected="tests/$name.out"
+  [ -f "tests/$name.c.out" ] && expected="tests/$name.c.out"
+  check "$name" "emit-c" "$expected" "$work/$name.native"
+done
+
+echo "$passed passed, $failed failed"
+[ "$failed" -eq 0 ]
@@ -0,0 +1,106 @@
+; Frames one, two and three levels out, read again after the calls in
+; between have returned. c reaches a through a recursive call from
+; three levels in, so the display entries for a, b and c are replaced
+; and must be put back on every return.
+;
+; program display;
+; var g : integer;
+; procedure a(n : integer);
+; var x : integer;
+;   procedure b;
+;   var y : integer;
+;     procedure c(m : integer);
+;     begin
+;       if m > 0 then call c(m - 1);
+;       if n > 0 then call a(n - 1);
+;       g := (g * 7 + x * 3 + y) mod 1000003
+;     end;
+;   begin
+;     y := n * 10 + 1;
+;     call c(2);
+;     call writei(y); call writec(' ')
+;   end;
+; begin
+;   x := n * 100 + 5;
+;   call b;
+;   call writei(x); call writeln
+; end;
+; begin
+;   g := 0;
+;   call a(2);
+;   call writei(g); call writeln
+; end.
+0:  INT 5
+1:  LC 0
+2:  STL 0,4             ; g := 0
+3:  INT 4
+4:  LC 2
+5:  DCT 5
+6:  CALL 0,11
+7:  LV 0,4
+8:  WRI
+9:  WLN
+10:  HL
+11:  INT 6
+12:  LV 0,4
+13:  LC 100
+14:  ML
+15:  LC 5
+16:  AD
+17:  STL 0,5            ; x := n * 100 + 5
+18:  INT 4
+19:  DCT 4
+20:  CALL 0,25
+21:  LV 0,5
+22:  WRI
+23:  WLN
+24:  EP
+25:  INT 5
+26:  LV 1,4
+27:  LC 10
+28:  ML
+29:  LC 1
+30:  AD
+31:  STL 0,4            ; y := n * 10 + 1
+32:  INT 4
+33:  LC 2
+34:  DCT 5
+35:  CALL 0,41
+36:  LV 0,4
+37:  WRI
+38:  LC 32
+39:  WRC
+40:  EP
+41:  INT 5
+42:  LV 0,4
+43:  LC 0
+44:  FGT 51
+45:  INT 4
+46:  LV 0,4
+47:  LC 1
+48:  SB
+49:  DCT 5
+50:  CALL 1,41          ; c itself, its static link is b
+51:  LV 2,4             ; n, two levels out
+52:  LC 0
+53:  FGT 60
+54:  INT 4
+55:  LV 2,4
+56:  LC 1
+57:  SB
+58:  DCT 5
+59:  CALL 3,11          ; a, whose static link is the program
+60:  LV 3,4             ; g, three levels out
+61:  LC 7
+62:  ML
+63:  LV 2,5             ; x
+64:  LC 3
+65:  ML
+66:  AD
+67:  LV 1,4             ; y
+68:  AD
+69:  LC 1000003
+70:  MOD
+71:  STL 3,4
+72:  EP
+
@@ -0,0 +1,87 @@
+; Division in a hot procedure by divisors only known at run time. A
+; divisor of -1 or 0 leaves native code: -1 is done by the interpreter,
+; 0 stops the program, at the same address in every mode.
+;
+; program divide;
+; var s : integer; r : integer; k : integer;
+; procedure q(k : integer);
+; var x : integer;
+; begin
+;   x := k mod 3 - 1;
+;   if (x != 0) or (k >= 2500) then
+;     begin s := s + k * 1000 / x; r := r + k * 7 mod x end
+; end;
+; begin
+;   call writei(-2147483648 / -1); call writeln;
+;   s := 0; r := 0;
+;   for k := 1 to 3000 do
+;     begin
+;       call q(k);
+;       if k mod 500 = 0 then begin call writei(s); call writec(' '); call writei(r); call writeln end
+;     end
+; end.
+0:  INT 7
+1:  LC -2147483648
+2:  LC -1
+3:  DV
+4:  WRI
+5:  WLN
+6:  LC 0
+7:  STL 0,4             ; s := 0
+8:  LC 0
+9:  STL 0,5             ; r := 0
+10:  LC 1
+11:  STL 0,6            ; k := 1
+12:  LV 0,6
+13:  LC 3000
+14:  FLE 33
+15:  INT 4
+16:  LV 0,6
+17:  DCT 5
+18:  CALL 0,34
+19:  LV 0,6
+20:  LC 500
+21:  MOD
+22:  LC 0
+23:  FEQ 31
+24:  LV 0,4
+25:  WRI
+26:  LC 32
+27:  WRC
+28:  LV 0,5
+29:  WRI
+30:  WLN
+31:  INC 6,1
+32:  J 12
+33:  HL
+34:  INT 6
+35:  LV 0,4
+36:  LC 3
+37:  MOD
+38:  LC 1
+39:  SB
+40:  STL 0,5            ; x := k mod 3 - 1
+41:  LV 0,5
+42:  LC 0
+43:  FEQ 47
+44:  LV 0,4
+45:  LC 2500
+46:  FGE 63
+47:  LV 1,4
+48:  LV 0,4
+49:  LC 1000
+50:  ML
+51:  LV 0,5
+52:  DV
+53:  AD
+54:  STL 1,4            ; s := s + k * 1000 / x
+55:  LV 1,5
+56:  LV 0,4
+57:  LC 7
+58:  ML
+59:  LV 0,5
+60:  MOD
+61:  AD
+62:  STL 1,5            ; r := r + k * 7 mod x
+63:  EP
+
@@ -0,0 +1,41 @@
+; Recursion without end runs out of stack. Every mode reports the
+; overflow at the CALL that could not get its frame.
+;
+; program overflow;
+; var n : integer;
+; procedure p;
+; var x : integer;
+; begin
+;   n := n + 1;
+;   if n mod 100000 = 0 then begin call writei(n); call writeln end;
+;   call p
+; end;
+; begin
+;   n := 0;
+;   call p
+; end.
+0:  INT 5
+1:  LC 0
+2:  STL 0,4             ; n := 0
+3:  INT 4
+4:  DCT 4
+5:  CALL 0,7
+6:  HL
+7:  INT 5
+8:  LV 1,4
+9:  LC 1
+10:  AD
+11:  STL 1,4            ; n := n + 1
+12:  LV 1,4
+13:  LC 100000
+14:  MOD
+15:  LC 0
+16:  FEQ 20
+17:  LV 1,4
+18:  WRI
+19:  WLN
+20:  INT 4
+21:  DCT 4
+22:  CALL 1,7
+23:  EP
+
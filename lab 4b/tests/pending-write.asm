@@ -0,0 +1,23 @@
+; INC and STL write operand stack slots whose values are still pending
+; constants or copies in the register translation.
+0:  INT 4
+1:  LC 5
+2:  INC 4,1
+3:  WRI
+4:  WLN
+5:  LC 5
+6:  LC 9
+7:  STL 0,4
+8:  WRI
+9:  WLN
+10:  INT 1
+11:  LC 7
+12:  STL 0,4
+13:  LV 0,4
+14:  LC 3
+15:  STL 0,5
+16:  WRI
+17:  WLN
+18:  WRI
+19:  WLN
+20:  HL
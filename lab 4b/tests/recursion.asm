@@ -0,0 +1,37 @@
+; A function 3000 calls deep: each return goes through EF into the
+; caller's native code.
+;
+; program recursion;
+; function f(n : integer) : integer;
+; begin
+;   if n = 0 then f := 0 else f := n + f(n - 1)
+; end;
+; begin
+;   call writei(f(3000)); call writeln
+; end.
+0:  INT 4
+1:  INT 4
+2:  LC 3000
+3:  DCT 5
+4:  CALL 0,8
+5:  WRI
+6:  WLN
+7:  HL
+8:  INT 5
+9:  LV 0,4
+10:  LC 0
+11:  FEQ 15
+12:  LC 0
+13:  STL 0,0            ; f := 0
+14:  EF
+15:  LV 0,4
+16:  INT 4
+17:  LV 0,4
+18:  LC 1
+19:  SB                 ; n - 1
+20:  DCT 5
+21:  CALL 1,8
+22:  AD
+23:  STL 0,0            ; f := n + f(n - 1)
+24:  EF
+
@@ -0,0 +1,7 @@
+; A CALL below the reserved words would put the callee's links over
+; the caller's.
+0:  CALL 0,2
+1:  HL
+2:  INT 4
+3:  EP
+
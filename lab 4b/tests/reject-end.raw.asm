@@ -0,0 +1,4 @@
+; Execution may fall off the end of the code.
+0:  INT 4
+1:  LC 1
+
@@ -0,0 +1,7 @@
+; Two paths reach the same instruction with different stack heights.
+0:  INT 4
+1:  RI
+2:  FJ 4
+3:  LC 1
+4:  HL
+
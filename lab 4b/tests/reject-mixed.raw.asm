@@ -0,0 +1,13 @@
+; A procedure returning both by EP and by EF cannot be called.
+0:  INT 4
+1:  RI
+2:  INT 4
+3:  DCT 5
+4:  CALL 0,6
+5:  HL
+6:  INT 5
+7:  LV 0,4
+8:  FJ 10
+9:  EP
+10:  EF
+
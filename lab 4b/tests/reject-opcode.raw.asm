@@ -0,0 +1,5 @@
+; An opcode that does not exist is rejected before anything runs.
+0:  LC 1
+1:  99
+2:  HL
+
@@ -0,0 +1,7 @@
+; Shift counts are limited to 0..30.
+0:  INT 4
+1:  LC 1
+2:  SHL 31
+3:  WRI
+4:  HL
+
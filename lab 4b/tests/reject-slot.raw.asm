@@ -0,0 +1,6 @@
+; A local slot below the frame is rejected.
+0:  INT 4
+1:  LV 0,-1
+2:  WRI
+3:  HL
+
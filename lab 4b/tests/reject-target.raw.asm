@@ -0,0 +1,5 @@
+; A jump out of the code is rejected.
+0:  LC 1
+1:  FJ 7
+2:  HL
+
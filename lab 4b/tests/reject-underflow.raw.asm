@@ -0,0 +1,5 @@
+; Popping below the frame is rejected.
+0:  INT 4
+1:  DCT 6
+2:  HL
+
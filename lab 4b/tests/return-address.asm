@@ -0,0 +1,18 @@
+; A procedure that overwrites its return address: EP must not jump there.
+0:  INT 4
+1:  LC 1
+2:  WRI
+3:  WLN
+4:  INT 4
+5:  DCT 4
+6:  CALL 0,11
+7:  LC 2
+8:  WRI
+9:  WLN
+10:  HL
+11:  INT 4
+12:  LA 0,2
+13:  LC 0
+14:  ST
+15:  EP
+
@@ -0,0 +1,27 @@
+; q links its frame to main's instead of its caller p's: the return
+; then lands in p with the wrong stack height.
+0:  INT 4
+1:  INT 4
+2:  DCT 4
+3:  CALL 0,8
+4:  LC 3
+5:  WRI
+6:  WLN
+7:  HL
+8:  INT 4
+9:  LC 1
+10:  WRI
+11:  WLN
+12:  INT 4
+13:  DCT 4
+14:  CALL 0,19
+15:  LC 2
+16:  WRI
+17:  WLN
+18:  EP
+19:  INT 4
+20:  LA 0,1
+21:  LC 0
+22:  ST
+23:  EP
+
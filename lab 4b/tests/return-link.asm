@@ -0,0 +1,17 @@
+; A function that points its dynamic link above its own frame.
+0:  INT 4
+1:  INT 4
+2:  DCT 4
+3:  CALL 0,7
+4:  WRI
+5:  WLN
+6:  HL
+7:  INT 4
+8:  LA 0,0
+9:  LC 7
+10:  ST
+11:  LA 0,1
+12:  LC 1000
+13:  ST
+14:  EF
+
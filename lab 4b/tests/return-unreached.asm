@@ -0,0 +1,15 @@
+; p returns to the address after a call that never runs: the verifier
+; knows no stack height there, so no return can resume at it.
+0:  INT 4
+1:  CALL 0,8
+2:  LC 1
+3:  WRI
+4:  WLN
+5:  HL
+6:  CALL 0,8
+7:  HL
+8:  INT 4
+9:  LA 0,2
+10:  LC 7
+11:  ST
+12:  EP
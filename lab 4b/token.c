@@ -4,14 +4,28 @@
  * @version 1.0
  */
 
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <ctype.h>
 #include "token.h"
 
-struct {
-  char string[MAX_IDENT_LEN + 1];
+/*
+ * Keywords are found with a perfect hash over the length and the first
+ * and last letters of the (upper case) identifier. The table is filled
+ * from keywordList on the first lookup, hashing each keyword string as
+ * identifiers are hashed; two keywords in one slot stop the compiler
+ * there, so a keyword can never be dropped silently. The 20 keywords
+ * land in distinct slots of a 64 entry table, so a lookup is one probe
+ * and one compare; empty slots have length 0 and never match.
+ */
+#define KEYWORD_TABLE_SIZE 64
+#define KEYWORD_HASH(len, first, last) (((len) + 2 * (first) + (last)) & (KEYWORD_TABLE_SIZE - 1))
+
+static struct {
+  char* string;
   TokenType tokenType;
-} keywords[KEYWORDS_COUNT] = {
+} keywordList[] = {
   {"PROGRAM", KW_PROGRAM},
   {"CONST", KW_CONST},
   {"TYPE", KW_TYPE},
@@ -34,30 +48,70 @@ struct {
   {"TO", KW_TO}
 };
 
-int keywordEq(char *kw, char *string) {
-  while ((*kw != '\0') && (*string != '\0')) {
-    if (*kw != *string) break;
-    kw ++; string ++;
+static struct {
+  char string[MAX_IDENT_LEN + 1];
+  int length;
+  TokenType tokenType;
+} keywords[KEYWORD_TABLE_SIZE];
+
+static int keywordsReady = 0;
+
+static int hashKeyword(char* string, int length) {
+  return KEYWORD_HASH(length, (unsigned char) string[0], (unsigned char) string[length - 1]);
+}
+
+static void makeKeywordTable(void) {
+  int n = sizeof(keywordList) / sizeof(keywordList[0]);
+  int length, h, i;
+
+  for (i = 0; i < n; i ++) {
+    length = strlen(keywordList[i].string);
+    h = hashKeyword(keywordList[i].string, length);
+    if (keywords[h].length != 0) {
+      fprintf(stderr, "Keywords %s and %s have the same hash %d!\n", keywords[h].string, keywordList[i].string, h);
+      exit(-1);
+    }
+    strcpy(keywords[h].string, keywordList[i].string);
+    keywords[h].length = length;
+    keywords[h].tokenType = keywordList[i].tokenType;
   }
-  return ((*kw == '\0') && (*string == '\0'));
+  keywordsReady = 1;
 }
 
 TokenType checkKeyword(char *string) {
-  int i;
-  for (i = 0; i < KEYWORDS_COUNT; i++)
-    if (keywordEq(keywords[i].string, string)) 
-      return keywords[i].tokenType;
+  int length = strlen(string);
+  int h;
+
+  if (!keywordsReady) makeKeywordTable();
+  if (length == 0) return TK_NONE;
+  h = hashKeyword(string, length);
+  if ((keywords[h].length == length) && (memcmp(keywords[h].string, string, length) == 0))
+    return keywords[h].tokenType;
   return TK_NONE;
 }
 
+/*
+ * The parser only holds the current token and one token of lookahead, so
+ * tokens come from a fixed ring instead of the heap. makeToken() fills
+ * the free slot and acceptToken() hands it out; a discarded token leaves
+ * its slot to be overwritten by the next one.
+ */
+static Token tokenRing[TOKEN_RING_SIZE];
+static int tokenRingIndex = 0;
+
 Token* makeToken(TokenType tokenType, int lineNo, int colNo) {
-  Token *token = (Token*)malloc(sizeof(Token));
+  Token *token = &tokenRing[tokenRingIndex];
+  token->string = "";
   token->tokenType = tokenType;
   token->lineNo = lineNo;
   token->colNo = colNo;
   return token;
 }
 
+void acceptToken(void) {
+  tokenRingIndex = (tokenRingIndex + 1) & (TOKEN_RING_SIZE - 1);
+}
+
 char *tokenToString(TokenType tokenType) {
   switch (tokenType) {
   case TK_NONE: return "None";
@@ -8,7 +8,6 @@
 #define __TOKEN_H__
 
 #define MAX_IDENT_LEN 15
-#define KEYWORDS_COUNT 20
 
 typedef enum {
   TK_NONE, TK_IDENT, TK_NUMBER, TK_CHAR, TK_EOF,
@@ -26,8 +25,11 @@ typedef enum {
   SB_LPAR, SB_RPAR, SB_LSEL, SB_RSEL
 } TokenType; 
 
+// Tokens are recycled after TOKEN_RING_SIZE tokens have been accepted
+#define TOKEN_RING_SIZE 4
+
 typedef struct {
-  char string[MAX_IDENT_LEN + 1];
+  char *string;                 // interned lexeme, shared by equal tokens
   int lineNo, colNo;
   TokenType tokenType;
   int value;
@@ -35,6 +37,7 @@ typedef struct {
 
 TokenType checkKeyword(char *string);
 Token* makeToken(TokenType tokenType, int lineNo, int colNo);
+void acceptToken(void);
 char *tokenToString(TokenType tokenType);
 
 
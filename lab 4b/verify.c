@@ -0,0 +1,374 @@
+/*
+ * @copyright (c) 2008, Hedspi, Hanoi University of Technology
+ * @author Huu-Duc Nguyen
+ * @version 1.0
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "verify.h"
+
+// A procedure that returns both by EP and by EF
+#define MIXED_RETURN (-1)
+
+// The state of one verification, passed to every helper so that verifyCode is reentrant
+typedef struct {
+  CodeBlock* source;
+  Verification* result;
+  int* mark;                // stamp of the last walk that reached each address
+  int stamp;
+  CodeAddress* worklist;
+  CodeAddress* reached;
+  int failed;
+  CodeAddress errorAt;
+} Verifier;
+
+static void fail(Verifier* v, CodeAddress i) {
+  if (!v->failed) {
+    v->failed = 1;
+    v->errorAt = i;
+  }
+}
+
+static int max(int a, int b) {
+  return (a > b) ? a : b;
+}
+
+/******************************************************************/
+
+int isJump(enum OpCode op) {
+  return (op == OP_J) || (op == OP_FJ) || ((op >= OP_FEQ) && (op <= OP_FLE)) || (op == OP_LOOP);
+}
+
+void stackEffect(Instruction* inst, int* pops, int* pushes) {
+  *pops = 0;
+  *pushes = 0;
+
+  switch (inst->op) {
+  case OP_LA:
+  case OP_LV:
+  case OP_LC:
+  case OP_RC:
+  case OP_RI:
+  case OP_ADV:
+    *pushes = 1;
+    break;
+  case OP_LI:
+  case OP_NEG:
+  case OP_SHL:
+  case OP_SHR:
+  case OP_AND:
+    *pops = 1;
+    *pushes = 1;
+    break;
+  case OP_CV:
+    *pops = 1;
+    *pushes = 2;
+    break;
+  case OP_FJ:
+  case OP_WRC:
+  case OP_WRI:
+  case OP_STL:
+  case OP_LOOP:
+    *pops = 1;
+    break;
+  case OP_ST:
+  case OP_FEQ:
+  case OP_FNE:
+  case OP_FGT:
+  case OP_FLT:
+  case OP_FGE:
+  case OP_FLE:
+    *pops = 2;
+    break;
+  case OP_AD:
+  case OP_SB:
+  case OP_ML:
+  case OP_DV:
+  case OP_MOD:
+  case OP_EQ:
+  case OP_NE:
+  case OP_GT:
+  case OP_LT:
+  case OP_GE:
+  case OP_LE:
+    *pops = 2;
+    *pushes = 1;
+    break;
+  case OP_INT:
+    if (inst->q >= 0) *pushes = inst->q;
+    else *pops = - inst->q;
+    break;
+  case OP_DCT:
+    if (inst->q >= 0) *pops = inst->q;
+    else *pushes = - inst->q;
+    break;
+  default:
+    break;
+  }
+}
+
+/******************* Analysis ******************************/
+
+// Every opcode is known and every target in range, reachable or not
+static void checkInstructions(Verifier* v) {
+  Instruction* inst;
+  int i;
+
+  if ((v->source->entry < 0) || (v->source->entry >= v->source->codeSize)) {
+    fail(v, 0);
+    return;
+  }
+
+  for (i = 0; (i < v->source->codeSize) && !v->failed; i ++) {
+    inst = v->source->code + i;
+    if ((unsigned) inst->op > MAX_OPCODE) fail(v, i);
+    else if ((isJump(inst->op) || (inst->op == OP_CALL)) &&
+	     ((inst->q < 0) || (inst->q >= v->source->codeSize)))
+      fail(v, i);
+    else if (((inst->op == OP_INT) || (inst->op == OP_DCT)) &&
+	     ((inst->q > MAX_FRAME_SLOTS) || (inst->q < - MAX_FRAME_SLOTS)))
+      fail(v, i);
+    else if (((inst->op == OP_SHL) || (inst->op == OP_SHR)) && ((inst->q < 0) || (inst->q > MAX_SHIFT)))
+      fail(v, i);
+  }
+}
+
+// Collect the addresses reachable from a procedure start without entering its callees
+static int walkProcedure(Verifier* v, CodeAddress start) {
+  Instruction* inst;
+  CodeAddress next[2];
+  int count = 0, done = 0;
+  int i, k;
+
+  v->stamp ++;
+  v->mark[start] = v->stamp;
+  v->reached[count++] = start;
+
+  while (done < count) {
+    i = v->reached[done++];
+    inst = v->source->code + i;
+    k = 0;
+
+    switch (inst->op) {
+    case OP_J:
+      next[k++] = inst->q;
+      break;
+    case OP_EP:
+    case OP_EF:
+    case OP_HL:
+      break;
+    default:
+      next[k++] = i + 1;
+      if (isJump(inst->op)) next[k++] = inst->q;
+      break;
+    }
+
+    // Falling off the end only matters when reachable: computeHeights() sees it
+    while (k-- > 0)
+      if ((next[k] < v->source->codeSize) && (v->mark[next[k]] != v->stamp)) {
+	v->mark[next[k]] = v->stamp;
+	v->reached[count++] = next[k];
+      }
+  }
+  return count;
+}
+
+static void computeReturns(Verifier* v, char* isTarget) {
+  Instruction* inst;
+  int count;
+  int i, k, r;
+
+  for (i = 0; i < v->source->codeSize; i ++) {
+    if (!isTarget[i]) continue;
+    count = walkProcedure(v, i);
+    r = UNREACHED;
+    for (k = 0; k < count; k ++) {
+      inst = v->source->code + v->reached[k];
+      if ((inst->op == OP_EP) || (inst->op == OP_EF)) {
+	if ((r != UNREACHED) && (r != (inst->op == OP_EF))) r = MIXED_RETURN;
+	else r = (inst->op == OP_EF);
+	if (r == MIXED_RETURN) break;
+      }
+    }
+    v->result->returned[i] = r;
+  }
+}
+
+static void setHeight(Verifier* v, CodeAddress from, CodeAddress i, int h, int* count) {
+  int* height = v->result->height;
+
+  if ((i >= v->source->codeSize) || (h < -1) || (h > MAX_FRAME_SLOTS)) fail(v, from);
+  else if (height[i] == UNREACHED) {
+    height[i] = h;
+    v->worklist[(*count)++] = i;
+  } else if (height[i] != h) fail(v, from);
+}
+
+static void computeHeights(Verifier* v) {
+  Instruction* inst;
+  int pops, pushes;
+  int count = 0, done = 0;
+  int h, i, r;
+
+  v->result->isStart[v->source->entry] = 1;
+  setHeight(v, v->source->entry, v->source->entry, -1, &count);
+
+  while ((done < count) && !v->failed) {
+    i = v->worklist[done++];
+    inst = v->source->code + i;
+    h = v->result->height[i];
+
+    stackEffect(inst, &pops, &pushes);
+    if (h - pops < -1) {
+      fail(v, i);
+      break;
+    }
+    h = h - pops + pushes;
+
+    switch (inst->op) {
+    case OP_J:
+      setHeight(v, i, inst->q, h, &count);
+      break;
+    case OP_CALL:
+      // The callee's frame starts right above the current top, clear of our links
+      r = v->result->returned[inst->q];
+      if ((h < RESERVED_WORDS - 1) || (r == MIXED_RETURN)) {
+	fail(v, i);
+	break;
+      }
+      v->result->isStart[inst->q] = 1;
+      setHeight(v, i, inst->q, -1, &count);
+      if (r != UNREACHED)
+	setHeight(v, i, i + 1, h + r, &count);
+      break;
+    case OP_EP:
+    case OP_EF:
+    case OP_HL:
+      break;
+    default:
+      setHeight(v, i, i + 1, h, &count);
+      if (isJump(inst->op)) setHeight(v, i, inst->q, h, &count);
+      break;
+    }
+  }
+}
+
+// Highest slot relative to b that one instruction may touch
+static int slotsUsed(Verifier* v, CodeAddress i, int h) {
+  Instruction* inst = v->source->code + i;
+  int pops, pushes;
+  int m;
+
+  stackEffect(inst, &pops, &pushes);
+  m = max(h, h - pops + pushes);
+
+  switch (inst->op) {
+  case OP_LV:
+  case OP_STL:
+    if (inst->p == 0) {
+      if (inst->q < 0) fail(v, i);
+      m = max(m, inst->q);
+    }
+    break;
+  case OP_INC:
+  case OP_LOOP:
+    if (inst->p < 0) fail(v, i);
+    m = max(m, inst->p);
+    break;
+  case OP_ADV:
+    if ((inst->p < 0) || (inst->q < 0)) fail(v, i);
+    m = max(m, max(inst->p, inst->q));
+    break;
+  case OP_CALL:
+    m = max(m, h + RESERVED_WORDS);
+    break;
+  default:
+    break;
+  }
+
+  if (m > MAX_FRAME_SLOTS) fail(v, i);
+  return m;
+}
+
+// Code shared by several procedures gets the largest of their limits
+static void computeLimits(Verifier* v) {
+  int* height = v->result->height;
+  int count, procLimit;
+  int i, k;
+
+  for (i = 0; (i < v->source->codeSize) && !v->failed; i ++) {
+    if (!v->result->isStart[i]) continue;
+    count = walkProcedure(v, i);
+    procLimit = RESERVED_WORDS - 1;
+    for (k = 0; k < count; k ++)
+      if (height[v->reached[k]] != UNREACHED)
+	procLimit = max(procLimit, slotsUsed(v, v->reached[k], height[v->reached[k]]));
+    for (k = 0; k < count; k ++) {
+      v->result->limit[v->reached[k]] = max(v->result->limit[v->reached[k]], procLimit);
+      if (v->result->procedure[v->reached[k]] < 0) v->result->procedure[v->reached[k]] = i;
+    }
+  }
+}
+
+/******************************************************************/
+
+Verification* verifyCode(CodeBlock* codeBlock, CodeAddress* errorAddress) {
+  Verifier verifier;
+  Verifier* v = &verifier;
+  Verification* result;
+  int n = codeBlock->codeSize;
+  char* isTarget;
+  int i;
+
+  v->source = codeBlock;
+  v->failed = 0;
+  v->stamp = 0;
+
+  result = (Verification*) malloc(sizeof(Verification));
+  result->height = (int*) malloc(n * sizeof(int));
+  result->limit = (int*) calloc(n, sizeof(int));
+  result->returned = (int*) malloc(n * sizeof(int));
+  result->isStart = (char*) calloc(n, sizeof(char));
+  result->procedure = (CodeAddress*) malloc(n * sizeof(CodeAddress));
+  v->result = result;
+  isTarget = (char*) calloc(n, sizeof(char));
+  v->mark = (int*) calloc(n, sizeof(int));
+  v->worklist = (CodeAddress*) malloc(n * sizeof(CodeAddress));
+  v->reached = (CodeAddress*) malloc(n * sizeof(CodeAddress));
+  for (i = 0; i < n; i ++) {
+    result->height[i] = UNREACHED;
+    result->returned[i] = UNREACHED;
+    result->procedure[i] = -1;
+  }
+
+  checkInstructions(v);
+  if (!v->failed) {
+    for (i = 0; i < n; i ++)
+      if (codeBlock->code[i].op == OP_CALL) isTarget[codeBlock->code[i].q] = 1;
+    computeReturns(v, isTarget);
+    computeHeights(v);
+  }
+  if (!v->failed) computeLimits(v);
+
+  free(isTarget);
+  free(v->mark);
+  free(v->worklist);
+  free(v->reached);
+
+  if (v->failed) {
+    *errorAddress = v->errorAt;
+    freeVerification(result);
+    return NULL;
+  }
+  return result;
+}
+
+void freeVerification(Verification* verification) {
+  free(verification->height);
+  free(verification->limit);
+  free(verification->returned);
+  free(verification->isStart);
+  free(verification->procedure);
+  free(verification);
+}
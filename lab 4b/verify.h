@@ -0,0 +1,46 @@
+/*
+ * @copyright (c) 2008, Hedspi, Hanoi University of Technology
+ * @author Huu-Duc Nguyen
+ * @version 1.0
+ */
+
+#ifndef __VERIFY_H__
+#define __VERIFY_H__
+
+#include <limits.h>
+#include "instructions.h"
+
+#define UNREACHED INT_MIN
+
+// Larger frames are rejected
+#define MAX_FRAME_SLOTS (1 << 24)
+
+/*
+ * Facts proved about a code block before it runs. Every opcode is known,
+ * every jump and call target is in range, no reachable instruction falls
+ * off the end, and each reachable instruction is always reached with the
+ * same stack height relative to b, never below the frame. A procedure
+ * starts at the entry or at a CALL target and returns always by EP or
+ * always by EF.
+ */
+
+struct Verification_ {
+  int* height;             // t - b before each instruction, UNREACHED if never reached
+  int* limit;              // highest slot relative to b that the procedure of each instruction touches
+  int* returned;           // per procedure start: words left on return, 0 for EP, 1 for EF
+  char* isStart;           // reachable procedure starts
+  CodeAddress* procedure;  // start of the first procedure reaching each instruction, or -1
+};
+
+typedef struct Verification_ Verification;
+
+int isJump(enum OpCode op);
+
+// Words an instruction pops and pushes; CALL, EP and EF are handled apart
+void stackEffect(Instruction* inst, int* pops, int* pushes);
+
+// NULL when the code is rejected; *errorAddress then tells where
+Verification* verifyCode(CodeBlock* codeBlock, CodeAddress* errorAddress);
+void freeVerification(Verification* verification);
+
+#endif
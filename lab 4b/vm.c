@@ -0,0 +1,731 @@
+/*
+ * @copyright (c) 2008, Hedspi, Hanoi University of Technology
+ * @author Huu-Duc Nguyen
+ * @version 1.0
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "vm.h"
+#include "verify.h"
+#include "regcode.h"
+#include "jit.h"
+
+VM* createVM(int stackSize) {
+  VM* vm = (VM*) malloc(sizeof(VM));
+
+  vm->stack = (WORD*) calloc(stackSize, sizeof(WORD));
+  vm->stackSize = stackSize;
+  vm->maxDepth = stackSize / RESERVED_WORDS + 1;
+  vm->display = (WORD*) malloc((vm->maxDepth + 1) * sizeof(WORD));
+  vm->links = (DisplayLink*) malloc(vm->maxDepth * sizeof(DisplayLink));
+  initIOBuffer(&vm->input, 0);
+  initIOBuffer(&vm->output, 1);
+  vm->input.echo = &vm->output;
+  vm->registerCode = 1;
+  vm->jit = 0;
+  vm->profile = NULL;
+  vm->pc = 0;
+  return vm;
+}
+
+void freeVM(VM* vm) {
+  cleanIOBuffer(&vm->input);
+  cleanIOBuffer(&vm->output);
+  free(vm->stack);
+  free(vm->display);
+  free(vm->links);
+  free(vm);
+}
+
+char* vmStatusToString(VMStatus status) {
+  switch (status) {
+  case VM_HALT: return "Halted.";
+  case VM_STACK_OVERFLOW: return "Stack overflow.";
+  case VM_DIVIDE_BY_ZERO: return "Division by zero.";
+  case VM_INVALID_ADDRESS: return "Invalid address.";
+  case VM_INVALID_INSTRUCTION: return "Invalid instruction.";
+  case VM_INVALID_CODE: return "Invalid code.";
+  case VM_IO_ERROR: return "I/O error.";
+  default: return "";
+  }
+}
+
+/******************************************************************/
+
+/*
+ * The interpreter loop is threaded with computed gotos: every handler
+ * ends with its own indirect jump through dispatchTable, so the branch
+ * predictor sees one jump site per opcode instead of a single switch.
+ * pc, t and b live in locals and are only written back on exit.
+ *
+ * The code has passed verifyCode(), so jumps stay in the code and pushes
+ * stay in the frame: neither pc nor t is checked per instruction. The
+ * whole frame of a procedure is checked against the stack size when it
+ * is called, and a return must land on a call site at the height that
+ * was verified there.
+ *
+ * Handlers dispatch through table. When profiling, it points to a table
+ * whose every entry counts the instruction first, so the handlers are
+ * the same and a run without a profile pays nothing for it.
+ */
+
+#define DISPATCH() goto *table[pc->op]
+
+#define NEXT() do { pc ++; DISPATCH(); } while (0)
+
+#define FRAME_CHECK(base, i) do {				\
+    if ((base) + limit[i] >= stackSize) goto stackOverflow;	\
+  } while (0)
+
+// Leave the frame at b for the call site before address i, with t at top
+#define RETURN(top) do {					\
+    i = s[b + RETURN_ADDRESS_OFFSET];				\
+    j = s[b + DYNAMIC_LINK_OFFSET];				\
+    if ((i <= 0) || (i >= codeSize) || (code[i - 1].op != OP_CALL) || \
+	((unsigned) j > (unsigned) b) || ((top) - j != height[i])) \
+      goto badAddress;						\
+    FRAME_CHECK(j, i);						\
+    DISPLAY_LEAVE();						\
+    t = (top);							\
+    b = j;							\
+    pc = code + i;						\
+    DISPATCH();							\
+  } while (0)
+
+#define ADDRESS_CHECK(a) do {					\
+    if ((unsigned) (a) >= (unsigned) stackSize) goto badAddress; \
+  } while (0)
+
+/*
+ * Non-local frames come from the display instead of the static chain,
+ * so their cost does not depend on the distance. A level reaching past
+ * the program frame is an invalid address.
+ */
+
+#define FRAME(p) display[level - (p)]
+
+#define LEVEL_CHECK(p) do {					\
+    if ((unsigned) (p) > (unsigned) level) goto badAddress;	\
+  } while (0)
+
+// Enter a procedure p levels out from the caller, whose frame starts at b
+#define DISPLAY_ENTER(p) do {					\
+    if (depth == vm->maxDepth) goto stackOverflow;		\
+    links[depth].level = level;					\
+    level += 1 - (p);						\
+    links[depth].entry = display[level];			\
+    depth ++;							\
+    display[level] = b;						\
+  } while (0)
+
+#define DISPLAY_LEAVE() do {					\
+    if (depth == 0) goto badAddress;				\
+    depth --;							\
+    display[level] = links[depth].entry;			\
+    level = links[depth].level;					\
+  } while (0)
+
+// Compare the two topmost words, pop both and jump when the test fails
+#define FALSE_JUMP(cond) do {					\
+    t -= 2;							\
+    if (!(cond)) {						\
+      pc = code + pc->q;					\
+      DISPATCH();						\
+    }								\
+    NEXT();							\
+  } while (0)
+
+// x / 2^q rounded toward 0, as DV rounds: negative x is biased up first
+static inline WORD shiftRight(WORD x, int q) {
+  return (x + ((x >> 31) & ((1 << q) - 1))) >> q;
+}
+
+static inline WORD shiftLeft(WORD x, int q) {
+  return (WORD) ((unsigned) x << q);
+}
+
+static VMStatus runStack(VM* vm, CodeBlock* codeBlock, Verification* verification) {
+  static void* dispatchTable[] = {
+    &&do_LA, &&do_LV, &&do_LC, &&do_LI, &&do_INT, &&do_DCT,
+    &&do_J, &&do_FJ, &&do_HL, &&do_ST, &&do_CALL, &&do_EP, &&do_EF,
+    &&do_RC, &&do_RI, &&do_WRC, &&do_WRI, &&do_WLN,
+    &&do_AD, &&do_SB, &&do_ML, &&do_DV, &&do_NEG, &&do_CV,
+    &&do_EQ, &&do_NE, &&do_GT, &&do_LT, &&do_GE, &&do_LE,
+    &&do_BP,
+    &&do_ADV, &&do_INC, &&do_STL,
+    &&do_FEQ, &&do_FNE, &&do_FGT, &&do_FLT, &&do_FGE, &&do_FLE,
+    &&do_MOD, &&do_SHL, &&do_SHR, &&do_AND,
+    &&do_LOOP
+  };
+
+  void* profileTable[MAX_OPCODE + 1];
+  void** table = dispatchTable;
+  long long* count = NULL;
+
+  Instruction* code = codeBlock->code;
+  int codeSize = codeBlock->codeSize;
+  WORD* s = vm->stack;
+  int stackSize = vm->stackSize;
+  Instruction* pc = code + codeBlock->entry;
+  int* height = verification->height;
+  int* limit = verification->limit;
+  WORD* display = vm->display;
+  DisplayLink* links = vm->links;
+  int level = 0;
+  int depth = 0;
+  int t = -1;
+  int b = 0;
+  int i, j;
+  VMStatus status;
+
+  if (vm->profile != NULL) {
+    for (i = 0; i <= MAX_OPCODE; i ++)
+      profileTable[i] = &&do_COUNT;
+    table = profileTable;
+    count = vm->profile->count;
+  }
+
+  display[0] = b;
+  DISPATCH();
+
+ do_COUNT:
+  count[pc - code] ++;
+  goto *dispatchTable[pc->op];
+
+ do_LA:
+  LEVEL_CHECK(pc->p);
+  s[++t] = FRAME(pc->p) + pc->q;
+  NEXT();
+ do_LV:
+  LEVEL_CHECK(pc->p);
+  i = FRAME(pc->p) + pc->q;
+  ADDRESS_CHECK(i);
+  s[++t] = s[i];
+  NEXT();
+ do_LC:
+  s[++t] = pc->q;
+  NEXT();
+ do_LI:
+  ADDRESS_CHECK(s[t]);
+  s[t] = s[s[t]];
+  NEXT();
+ do_INT:
+  t += pc->q;
+  NEXT();
+ do_DCT:
+  t -= pc->q;
+  NEXT();
+ do_J:
+  pc = code + pc->q;
+  DISPATCH();
+ do_FJ:
+  if (s[t--] == 0) {
+    pc = code + pc->q;
+    DISPATCH();
+  }
+  NEXT();
+ do_HL:
+  status = VM_HALT;
+  goto done;
+ do_ST:
+  ADDRESS_CHECK(s[t-1]);
+  s[s[t-1]] = s[t];
+  t -= 2;
+  NEXT();
+ do_CALL:
+  FRAME_CHECK(t + 1, pc->q);
+  LEVEL_CHECK(pc->p);
+  s[t + 1 + DYNAMIC_LINK_OFFSET] = b;
+  s[t + 1 + RETURN_ADDRESS_OFFSET] = pc - code + 1;
+  s[t + 1 + STATIC_LINK_OFFSET] = FRAME(pc->p);
+  b = t + 1;
+  DISPLAY_ENTER(pc->p);
+  pc = code + pc->q;
+  DISPATCH();
+ do_EP:
+  RETURN(b - 1);
+ do_EF:
+  RETURN(b);
+ do_RC:
+  i = readChar(&vm->input);
+  if (i < 0) goto ioError;
+  s[++t] = i;
+  NEXT();
+ do_RI:
+  if (!readInt(&vm->input, &i)) goto ioError;
+  s[++t] = i;
+  NEXT();
+ do_WRC:
+  if (!writeChar(&vm->output, s[t--])) goto ioError;
+  NEXT();
+ do_WRI:
+  if (!writeInt(&vm->output, s[t--])) goto ioError;
+  NEXT();
+ do_WLN:
+  if (!writeLine(&vm->output)) goto ioError;
+  NEXT();
+ do_AD:
+  t --;
+  s[t] += s[t+1];
+  NEXT();
+ do_SB:
+  t --;
+  s[t] -= s[t+1];
+  NEXT();
+ do_ML:
+  t --;
+  s[t] *= s[t+1];
+  NEXT();
+ do_DV:
+  t --;
+  if (s[t+1] == 0) goto divideByZero;
+  if (s[t+1] == -1) s[t] = - s[t];
+  else s[t] /= s[t+1];
+  NEXT();
+ do_NEG:
+  s[t] = - s[t];
+  NEXT();
+ do_CV:
+  s[t+1] = s[t];
+  t ++;
+  NEXT();
+ do_EQ:
+  t --;
+  s[t] = (s[t] == s[t+1]);
+  NEXT();
+ do_NE:
+  t --;
+  s[t] = (s[t] != s[t+1]);
+  NEXT();
+ do_GT:
+  t --;
+  s[t] = (s[t] > s[t+1]);
+  NEXT();
+ do_LT:
+  t --;
+  s[t] = (s[t] < s[t+1]);
+  NEXT();
+ do_GE:
+  t --;
+  s[t] = (s[t] >= s[t+1]);
+  NEXT();
+ do_LE:
+  t --;
+  s[t] = (s[t] <= s[t+1]);
+  NEXT();
+ do_BP:
+  NEXT();
+
+ do_ADV:
+  t ++;
+  s[t] = s[b + pc->p] + s[b + pc->q];
+  NEXT();
+ do_INC:
+  s[b + pc->p] += pc->q;
+  NEXT();
+ do_STL:
+  LEVEL_CHECK(pc->p);
+  i = FRAME(pc->p) + pc->q;
+  ADDRESS_CHECK(i);
+  s[i] = s[t--];
+  NEXT();
+
+ do_FEQ:
+  FALSE_JUMP(s[t+1] == s[t+2]);
+ do_FNE:
+  FALSE_JUMP(s[t+1] != s[t+2]);
+ do_FGT:
+  FALSE_JUMP(s[t+1] > s[t+2]);
+ do_FLT:
+  FALSE_JUMP(s[t+1] < s[t+2]);
+ do_FGE:
+  FALSE_JUMP(s[t+1] >= s[t+2]);
+ do_FLE:
+  FALSE_JUMP(s[t+1] <= s[t+2]);
+
+ do_MOD:
+  t --;
+  if (s[t+1] == 0) goto divideByZero;
+  if (s[t+1] == -1) s[t] = 0;
+  else s[t] %= s[t+1];
+  NEXT();
+ do_SHL:
+  s[t] = shiftLeft(s[t], pc->q);
+  NEXT();
+ do_SHR:
+  s[t] = shiftRight(s[t], pc->q);
+  NEXT();
+ do_AND:
+  s[t] &= pc->q;
+  NEXT();
+
+ do_LOOP:
+  t --;
+  if (++ s[b + pc->p] <= s[t+1]) {
+    pc = code + pc->q;
+    DISPATCH();
+  }
+  NEXT();
+
+ stackOverflow:
+  status = VM_STACK_OVERFLOW;
+  goto done;
+ divideByZero:
+  status = VM_DIVIDE_BY_ZERO;
+  goto done;
+ badAddress:
+  status = VM_INVALID_ADDRESS;
+  goto done;
+ ioError:
+  status = VM_IO_ERROR;
+  goto done;
+
+ done:
+  // Output still buffered when the program halts may fail too
+  if (!flushOutput(&vm->output) && (status == VM_HALT)) status = VM_IO_ERROR;
+  vm->pc = pc - code;
+  return status;
+}
+
+/******************************************************************/
+
+/*
+ * Interpreter for the register form built by translateCode(). Operands
+ * are named by their offset from b, so t is never kept: its value at
+ * every instruction was fixed by the translation.
+ */
+
+#define R(x) s[b + (x)]
+
+#define REG_NEXT() do { pc ++; goto *dispatchTable[pc->op]; } while (0)
+
+// Loops are counted on their backward jump
+#define REG_JUMP() do {						\
+    i = pc->c;							\
+    if ((jit != NULL) && (i <= pc - code) && jitHot(jit, i))	\
+      JIT_ENTER(i);						\
+    pc = code + i;						\
+    goto *dispatchTable[pc->op];				\
+  } while (0)
+
+// Jump to c unless the test holds
+#define REG_FALSE_JUMP(cond) do {				\
+    if (!(cond)) REG_JUMP();					\
+    REG_NEXT();							\
+  } while (0)
+
+// Continue in native code from address a until it hands control back
+#define JIT_ENTER(a) do {					\
+    pc = code + jitRun(jit, s + b, (a));			\
+    goto *dispatchTable[pc->op];				\
+  } while (0)
+
+static VMStatus runRegisters(VM* vm, RegCode* regCode, Jit* jit) {
+  static void* dispatchTable[] = {
+    &&do_MOVE, &&do_LOADK, &&do_LA, &&do_LVN, &&do_LI,
+    &&do_ADD, &&do_SUB, &&do_MUL, &&do_DIV,
+    &&do_ADDK, &&do_SUBK, &&do_MULK, &&do_DIVK,
+    &&do_MOD, &&do_MODK, &&do_SHL, &&do_SHR, &&do_AND, &&do_NEG,
+    &&do_EQ, &&do_NE, &&do_GT, &&do_LT, &&do_GE, &&do_LE,
+    &&do_RC, &&do_RI,
+    &&do_ST, &&do_STN, &&do_INC,
+    &&do_WRC, &&do_WRI, &&do_WRCK, &&do_WRIK, &&do_WLN,
+    &&do_J, &&do_FJ,
+    &&do_FEQ, &&do_FNE, &&do_FGT, &&do_FLT, &&do_FGE, &&do_FLE,
+    &&do_FEQK, &&do_FNEK, &&do_FGTK, &&do_FLTK, &&do_FGEK, &&do_FLEK,
+    &&do_LOOP, &&do_LOOPK,
+    &&do_CALL, &&do_RET, &&do_CHECK, &&do_HL
+  };
+
+  RegInstruction* code = regCode->code;
+  WORD* s = vm->stack;
+  int stackSize = vm->stackSize;
+  RegInstruction* pc = code + regCode->entry;
+  WORD* display = vm->display;
+  DisplayLink* links = vm->links;
+  int level = 0;
+  int depth = 0;
+  int b = 0;
+  int i;
+  VMStatus status;
+
+  display[0] = b;
+  goto *dispatchTable[pc->op];
+
+ do_MOVE:
+  R(pc->a) = R(pc->b);
+  REG_NEXT();
+ do_LOADK:
+  R(pc->a) = pc->b;
+  REG_NEXT();
+ do_LA:
+  LEVEL_CHECK(pc->b);
+  R(pc->a) = FRAME(pc->b) + pc->c;
+  REG_NEXT();
+ do_LVN:
+  LEVEL_CHECK(pc->b);
+  i = FRAME(pc->b) + pc->c;
+  ADDRESS_CHECK(i);
+  R(pc->a) = s[i];
+  REG_NEXT();
+ do_LI:
+  ADDRESS_CHECK(R(pc->b));
+  R(pc->a) = s[R(pc->b)];
+  REG_NEXT();
+ do_ADD:
+  R(pc->a) = R(pc->b) + R(pc->c);
+  REG_NEXT();
+ do_SUB:
+  R(pc->a) = R(pc->b) - R(pc->c);
+  REG_NEXT();
+ do_MUL:
+  R(pc->a) = R(pc->b) * R(pc->c);
+  REG_NEXT();
+ do_DIV:
+  if (R(pc->c) == 0) goto divideByZero;
+  if (R(pc->c) == -1) R(pc->a) = - R(pc->b);
+  else R(pc->a) = R(pc->b) / R(pc->c);
+  REG_NEXT();
+ do_ADDK:
+  R(pc->a) = R(pc->b) + pc->c;
+  REG_NEXT();
+ do_SUBK:
+  R(pc->a) = R(pc->b) - pc->c;
+  REG_NEXT();
+ do_MULK:
+  R(pc->a) = R(pc->b) * pc->c;
+  REG_NEXT();
+ do_DIVK:
+  // translateCode() never divides by a constant 0 or -1
+  R(pc->a) = R(pc->b) / pc->c;
+  REG_NEXT();
+ do_MOD:
+  if (R(pc->c) == 0) goto divideByZero;
+  if (R(pc->c) == -1) R(pc->a) = 0;
+  else R(pc->a) = R(pc->b) % R(pc->c);
+  REG_NEXT();
+ do_MODK:
+  R(pc->a) = R(pc->b) % pc->c;
+  REG_NEXT();
+ do_SHL:
+  R(pc->a) = shiftLeft(R(pc->b), pc->c);
+  REG_NEXT();
+ do_SHR:
+  R(pc->a) = shiftRight(R(pc->b), pc->c);
+  REG_NEXT();
+ do_AND:
+  R(pc->a) = R(pc->b) & pc->c;
+  REG_NEXT();
+ do_NEG:
+  R(pc->a) = - R(pc->b);
+  REG_NEXT();
+ do_EQ:
+  R(pc->a) = (R(pc->b) == R(pc->c));
+  REG_NEXT();
+ do_NE:
+  R(pc->a) = (R(pc->b) != R(pc->c));
+  REG_NEXT();
+ do_GT:
+  R(pc->a) = (R(pc->b) > R(pc->c));
+  REG_NEXT();
+ do_LT:
+  R(pc->a) = (R(pc->b) < R(pc->c));
+  REG_NEXT();
+ do_GE:
+  R(pc->a) = (R(pc->b) >= R(pc->c));
+  REG_NEXT();
+ do_LE:
+  R(pc->a) = (R(pc->b) <= R(pc->c));
+  REG_NEXT();
+ do_RC:
+  i = readChar(&vm->input);
+  if (i < 0) goto ioError;
+  R(pc->a) = i;
+  REG_NEXT();
+ do_RI:
+  if (!readInt(&vm->input, &i)) goto ioError;
+  R(pc->a) = i;
+  REG_NEXT();
+ do_ST:
+  ADDRESS_CHECK(R(pc->a));
+  s[R(pc->a)] = R(pc->b);
+  REG_NEXT();
+ do_STN:
+  LEVEL_CHECK(pc->b);
+  i = FRAME(pc->b) + pc->c;
+  ADDRESS_CHECK(i);
+  s[i] = R(pc->a);
+  REG_NEXT();
+ do_INC:
+  R(pc->a) += pc->b;
+  REG_NEXT();
+ do_WRC:
+  if (!writeChar(&vm->output, R(pc->a))) goto ioError;
+  REG_NEXT();
+ do_WRI:
+  if (!writeInt(&vm->output, R(pc->a))) goto ioError;
+  REG_NEXT();
+ do_WRCK:
+  if (!writeChar(&vm->output, pc->a)) goto ioError;
+  REG_NEXT();
+ do_WRIK:
+  if (!writeInt(&vm->output, pc->a)) goto ioError;
+  REG_NEXT();
+ do_WLN:
+  if (!writeLine(&vm->output)) goto ioError;
+  REG_NEXT();
+ do_J:
+  REG_JUMP();
+ do_FJ:
+  REG_FALSE_JUMP(R(pc->a) != 0);
+ do_FEQ:
+  REG_FALSE_JUMP(R(pc->a) == R(pc->b));
+ do_FNE:
+  REG_FALSE_JUMP(R(pc->a) != R(pc->b));
+ do_FGT:
+  REG_FALSE_JUMP(R(pc->a) > R(pc->b));
+ do_FLT:
+  REG_FALSE_JUMP(R(pc->a) < R(pc->b));
+ do_FGE:
+  REG_FALSE_JUMP(R(pc->a) >= R(pc->b));
+ do_FLE:
+  REG_FALSE_JUMP(R(pc->a) <= R(pc->b));
+ do_FEQK:
+  REG_FALSE_JUMP(R(pc->a) == pc->b);
+ do_FNEK:
+  REG_FALSE_JUMP(R(pc->a) != pc->b);
+ do_FGTK:
+  REG_FALSE_JUMP(R(pc->a) > pc->b);
+ do_FLTK:
+  REG_FALSE_JUMP(R(pc->a) < pc->b);
+ do_FGEK:
+  REG_FALSE_JUMP(R(pc->a) >= pc->b);
+ do_FLEK:
+  REG_FALSE_JUMP(R(pc->a) <= pc->b);
+ do_LOOP:
+  if (++ R(pc->a) <= R(pc->b)) REG_JUMP();
+  REG_NEXT();
+ do_LOOPK:
+  if (++ R(pc->a) <= pc->b) REG_JUMP();
+  REG_NEXT();
+ do_CALL:
+  LEVEL_CHECK(pc->b);
+  i = b + pc->a;
+  s[i + DYNAMIC_LINK_OFFSET] = b;
+  s[i + RETURN_ADDRESS_OFFSET] = pc - code + 1;
+  s[i + STATIC_LINK_OFFSET] = FRAME(pc->b);
+  b = i;
+  DISPLAY_ENTER(pc->b);
+  pc = code + pc->c;
+  goto *dispatchTable[pc->op];
+ do_RET:
+  // The frame links are plain stack words: only return to a real call site
+  i = s[b + RETURN_ADDRESS_OFFSET];
+  if ((i <= 0) || (i >= regCode->codeSize) || (code[i - 1].op != R_CALL) ||
+      (s[b + DYNAMIC_LINK_OFFSET] + code[i - 1].a != b))
+    goto badAddress;
+  DISPLAY_LEAVE();
+  b = s[b + DYNAMIC_LINK_OFFSET];
+  if ((jit != NULL) && jitReady(jit, i))
+    JIT_ENTER(i);
+  pc = code + i;
+  goto *dispatchTable[pc->op];
+ do_CHECK:
+  // Procedures are counted on entry
+  if (b + pc->a >= stackSize) {
+    // The stack interpreter checks the frame at the call: report it there too
+    if (depth > 0) pc = code + s[b + RETURN_ADDRESS_OFFSET] - 1;
+    goto stackOverflow;
+  }
+  if ((jit != NULL) && jitHot(jit, pc - code + 1))
+    JIT_ENTER(pc - code + 1);
+  REG_NEXT();
+ do_HL:
+  status = VM_HALT;
+  goto done;
+
+ stackOverflow:
+  status = VM_STACK_OVERFLOW;
+  goto done;
+ divideByZero:
+  status = VM_DIVIDE_BY_ZERO;
+  goto done;
+ badAddress:
+  status = VM_INVALID_ADDRESS;
+  goto done;
+ ioError:
+  status = VM_IO_ERROR;
+  goto done;
+
+ done:
+  // Output still buffered when the program halts may fail too
+  if (!flushOutput(&vm->output) && (status == VM_HALT)) status = VM_IO_ERROR;
+  vm->pc = regCode->origin[pc - code];
+  return status;
+}
+
+VMStatus loadProgram(CodeBlock* codeBlock, int registerCode, int jit, Program** program, CodeAddress* errorAddress) {
+  Verification* verification;
+
+  // Untrusted images are rejected before anything runs
+  verification = verifyCode(codeBlock, errorAddress);
+  if (verification == NULL) {
+    if ((*errorAddress < codeBlock->codeSize) && ((unsigned) codeBlock->code[*errorAddress].op > MAX_OPCODE))
+      return VM_INVALID_INSTRUCTION;
+    return VM_INVALID_CODE;
+  }
+
+  *program = (Program*) malloc(sizeof(Program));
+  (*program)->codeBlock = codeBlock;
+  (*program)->verification = verification;
+  (*program)->regCode = registerCode ? translateCode(codeBlock, verification) : NULL;
+  // Compiled once per program: every run counts towards the same threshold
+  (*program)->jit = (registerCode && jit) ? createJit((*program)->regCode) : NULL;
+  return VM_HALT;
+}
+
+void freeProgram(Program* program) {
+  if (program->jit != NULL) freeJit(program->jit);
+  if (program->regCode != NULL) freeRegCode(program->regCode);
+  freeVerification(program->verification);
+  free(program);
+}
+
+void resetVM(VM* vm, int input, int output) {
+  // Uninitialized variables read the same as in a fresh VM
+  memset(vm->stack, 0, vm->stackSize * sizeof(WORD));
+  vm->pc = 0;
+  attachIOBuffer(&vm->input, input);
+  attachIOBuffer(&vm->output, output);
+}
+
+VMStatus runProgram(VM* vm, Program* program) {
+  CodeBlock* codeBlock = program->codeBlock;
+  Verification* verification = program->verification;
+  int i;
+
+  if (vm->profile != NULL)
+    for (i = 0; i < codeBlock->codeSize; i ++)
+      vm->profile->procedure[i] = verification->procedure[i];
+
+  vm->pc = codeBlock->entry;
+  if (verification->limit[codeBlock->entry] >= vm->stackSize)
+    return VM_STACK_OVERFLOW;
+  if (vm->registerCode && (program->regCode != NULL) && (vm->profile == NULL))
+    return runRegisters(vm, program->regCode, vm->jit ? program->jit : NULL);
+  return runStack(vm, codeBlock, verification);
+}
+
+VMStatus run(VM* vm, CodeBlock* codeBlock) {
+  Program* program;
+  VMStatus status;
+
+  status = loadProgram(codeBlock, vm->registerCode && (vm->profile == NULL), vm->jit, &program, &vm->pc);
+  if (status != VM_HALT) return status;
+
+  status = runProgram(vm, program);
+  freeProgram(program);
+  return status;
+}
@@ -0,0 +1,91 @@
+/*
+ * @copyright (c) 2008, Hedspi, Hanoi University of Technology
+ * @author Huu-Duc Nguyen
+ * @version 1.0
+ */
+
+#ifndef __VM_H__
+#define __VM_H__
+
+#include "instructions.h"
+#include "vmio.h"
+#include "profile.h"
+#include "verify.h"
+#include "regcode.h"
+#include "jit.h"
+
+#define DEFAULT_STACK_SIZE 1048576
+
+typedef enum {
+  VM_HALT,
+  VM_STACK_OVERFLOW,
+  VM_DIVIDE_BY_ZERO,
+  VM_INVALID_ADDRESS,
+  VM_INVALID_INSTRUCTION,
+  VM_INVALID_CODE,
+  VM_IO_ERROR
+} VMStatus;
+
+// What a CALL overwrites in the display, put back by the matching return
+struct DisplayLink_ {
+  WORD entry;              // display entry of the callee's level
+  int level;               // lexical level of the caller
+};
+
+typedef struct DisplayLink_ DisplayLink;
+
+struct VM_ {
+  WORD* stack;
+  int stackSize;
+
+  /*
+   * display[l] is the base of the innermost active frame at lexical
+   * level l, so the frame p static links up from a procedure at level
+   * n is display[n - p]. Every frame takes RESERVED_WORDS stack words,
+   * which bounds both the nesting and the call depth by maxDepth.
+   */
+  WORD* display;
+  DisplayLink* links;      // one per active call
+  int maxDepth;
+
+  IOBuffer input;
+  IOBuffer output;
+
+  int registerCode;        // translate the code to register form before running it
+  int jit;                 // run the native code of a program loaded with a JIT
+  Profile* profile;        // when set, the stack code runs and every instruction is counted
+
+  CodeAddress pc;          // address of the last executed instruction
+};
+
+typedef struct VM_ VM;
+
+/*
+ * A code block that passed verification, with its register form when
+ * asked for. Running it never writes to its code, so any number of VMs
+ * may share one; the native code of its JIT is shared the same way.
+ */
+struct Program_ {
+  CodeBlock* codeBlock;
+  Verification* verification;
+  RegCode* regCode;        // NULL when only the stack code runs
+  Jit* jit;                // NULL unless asked for along with the register form
+};
+
+typedef struct Program_ Program;
+
+VM* createVM(int stackSize);
+void freeVM(VM* vm);
+
+// Returns VM_HALT and sets *program, or the reason and address the code was rejected for
+VMStatus loadProgram(CodeBlock* codeBlock, int registerCode, int jit, Program** program, CodeAddress* errorAddress);
+void freeProgram(Program* program);
+
+// Start over on a zeroed stack, reading from and writing to these descriptors
+void resetVM(VM* vm, int input, int output);
+
+VMStatus runProgram(VM* vm, Program* program);
+VMStatus run(VM* vm, CodeBlock* codeBlock);
+char* vmStatusToString(VMStatus status);
+
+#endif
@@ -0,0 +1,122 @@
+/*
+ * @copyright (c) 2008, Hedspi, Hanoi University of Technology
+ * @author Huu-Duc Nguyen
+ * @version 1.0
+ */
+
+#include <stdlib.h>
+#include <errno.h>
+#include <unistd.h>
+#include "vmio.h"
+
+void initIOBuffer(IOBuffer* buffer, int fd) {
+  buffer->data = (char*) malloc(IO_BUFFER_SIZE);
+  buffer->echo = NULL;
+  attachIOBuffer(buffer, fd);
+}
+
+void attachIOBuffer(IOBuffer* buffer, int fd) {
+  buffer->fd = fd;
+  buffer->tty = isatty(fd);
+  buffer->position = 0;
+  buffer->count = 0;
+}
+
+void cleanIOBuffer(IOBuffer* buffer) {
+  free(buffer->data);
+}
+
+int flushOutput(IOBuffer* output) {
+  char* p = output->data;
+  int left = output->position;
+  int n;
+
+  output->position = 0;
+  while (left > 0) {
+    n = write(output->fd, p, left);
+    if (n < 0) {
+      if (errno == EINTR) continue;
+      return 0;
+    }
+    p += n;
+    left -= n;
+  }
+  return 1;
+}
+
+int fillInput(IOBuffer* input) {
+  int n;
+
+  // A prompt must be visible before the program waits for its answer
+  if (input->tty && (input->echo != NULL) && !flushOutput(input->echo)) {
+    input->position = 0;
+    input->count = 0;
+    return 0;
+  }
+
+  do n = read(input->fd, input->data, IO_BUFFER_SIZE);
+  while ((n < 0) && (errno == EINTR));
+
+  input->position = 0;
+  input->count = (n > 0) ? n : 0;
+  return n > 0;
+}
+
+static inline int peekChar(IOBuffer* input) {
+  if ((input->position == input->count) && !fillInput(input)) return -1;
+  return (unsigned char) input->data[input->position];
+}
+
+int readChar(IOBuffer* input) {
+  int c = peekChar(input);
+
+  if (c >= 0) input->position ++;
+  return c;
+}
+
+static int isSpace(int c) {
+  return (c == ' ') || ((c >= '\t') && (c <= '\r'));
+}
+
+int readInt(IOBuffer* input, WORD* value) {
+  unsigned n = 0;
+  int negative = 0;
+  int c;
+
+  while (isSpace(c = peekChar(input)))
+    input->position ++;
+
+  if ((c == '-') || (c == '+')) {
+    negative = (c == '-');
+    input->position ++;
+    c = peekChar(input);
+  }
+  if ((c < '0') || (c > '9')) return 0;
+
+  do {
+    n = n * 10 + (c - '0');
+    input->position ++;
+    c = peekChar(input);
+  } while ((c >= '0') && (c <= '9'));
+
+  *value = (WORD) (negative ? - n : n);
+  return 1;
+}
+
+int writeInt(IOBuffer* output, WORD value) {
+  char digits[MAX_INT_LENGTH];
+  unsigned n = (value < 0) ? - (unsigned) value : (unsigned) value;
+  int i = MAX_INT_LENGTH;
+
+  if ((output->position > IO_BUFFER_SIZE - MAX_INT_LENGTH) && !flushOutput(output)) return 0;
+
+  do {
+    digits[-- i] = '0' + n % 10;
+    n /= 10;
+  } while (n != 0);
+  if (value < 0) digits[-- i] = '-';
+
+  while (i < MAX_INT_LENGTH)
+    output->data[output->position ++] = digits[i ++];
+  return 1;
+}
@@ -0,0 +1,64 @@
+/*
+ * @copyright (c) 2008, Hedspi, Hanoi University of Technology
+ * @author Huu-Duc Nguyen
+ * @version 1.0
+ */
+
+#ifndef __VMIO_H__
+#define __VMIO_H__
+
+#include "instructions.h"
+
+#define IO_BUFFER_SIZE 65536
+
+// Room for the longest integer: sign and ten digits
+#define MAX_INT_LENGTH 11
+
+/*
+ * Buffered I/O of the VM on a file descriptor. Integers are formatted
+ * and parsed by hand, and output reaches the descriptor only when the
+ * buffer fills, at the end of a line written to a terminal, before
+ * input is read from a terminal, or when the program stops. A write
+ * returns 0 when flushing the buffer failed; what it held is lost.
+ */
+
+struct IOBuffer_ {
+  int fd;
+  int tty;                 // fd is a terminal
+  char* data;
+  int position;            // next byte to read or write
+  int count;               // bytes read into data (input only)
+  struct IOBuffer_* echo;  // output to flush before reading from a terminal
+};
+
+typedef struct IOBuffer_ IOBuffer;
+
+void initIOBuffer(IOBuffer* buffer, int fd);
+// Start over on another descriptor, dropping whatever the buffer holds
+void attachIOBuffer(IOBuffer* buffer, int fd);
+void cleanIOBuffer(IOBuffer* buffer);
+
+// Return 0 when the descriptor fails
+int flushOutput(IOBuffer* output);
+int fillInput(IOBuffer* input);
+
+// The next character, or -1 at the end of the input
+int readChar(IOBuffer* input);
+// Skip white space and read an optionally signed decimal integer; 0 if there is none
+int readInt(IOBuffer* input, WORD* value);
+
+int writeInt(IOBuffer* output, WORD value);
+
+static inline int writeChar(IOBuffer* output, int c) {
+  if ((output->position == IO_BUFFER_SIZE) && !flushOutput(output)) return 0;
+  output->data[output->position ++] = (char) c;
+  return 1;
+}
+
+static inline int writeLine(IOBuffer* output) {
+  if (!writeChar(output, '\n')) return 0;
+  if (output->tty) return flushOutput(output);
+  return 1;
+}
+
+#endif